@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0+ WITH Linux-syscall-note */
+/*
+ * shared imu ring of hid-betop-t6, /dev/betop-t6-imu<hid id> when the
+ * module is loaded with imu_ring=1.
+ *
+ * the device maps read only: a struct btp_t6_ring_header at offset 0 and
+ * BTP_T6_RING_SLOTS samples at data_offset. sample n (counting from 1)
+ * goes to slot (n - 1) % slots, published like this:
+ *
+ *     slot->seq = 0; wmb; fill slot; wmb; slot->seq = n; header->head = n;
+ *
+ * a reader loads head (acquire), copies slot (head - 1) % slots between two
+ * loads of its seq with rmb in between, and keeps the copy if both are head.
+ * older samples work the same, as long as they are less than slots behind.
+ *
+ * read() sleeps until watermark samples came since the last read() on that
+ * file and returns head as a __u64, poll() reports POLLIN on the same
+ * condition. the watermark is 1 until set with BTP_T6_RING_SET_WATERMARK.
+ *
+ * imu values are raw units with the gyro bias removed, before decimation:
+ * accel 4096 per g, gyro 16.383 per deg/s, axes like the IMU input device.
+ */
+#ifndef _HID_BETOP_T6_RING_H
+#define _HID_BETOP_T6_RING_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define BTP_T6_RING_VERSION 1
+#define BTP_T6_RING_SLOTS 1024
+
+struct btp_t6_ring_sample {
+    __u64 seq;
+    /* recovered sample time, CLOCK_MONOTONIC */
+    __u64 time_ns;
+    /* what went out as MSC_TIMESTAMP */
+    __u32 timestamp_us;
+    /* accel x y z, gyro x y z */
+    __s16 imu[6];
+};
+
+struct btp_t6_ring_header {
+    __u32 version;
+    __u32 slots;
+    __u32 sample_size;
+    __u32 data_offset;
+    __u64 head;
+};
+
+#define BTP_T6_RING_SET_WATERMARK _IOW(0xb6, 1, __u32)
+
+#endif
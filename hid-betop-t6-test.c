@@ -0,0 +1,348 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * kunit cases for the pure parts of hid-betop-t6: the axis tables, the
+ * timestamp pll and the report parser, plus a parse cost benchmark.
+ * included at the end of hid-betop-t6.c, so the static helpers are
+ * reachable, when built with `make KUNIT=1` or in a kernel tree with
+ * CONFIG_HID_BETOP_T6_KUNIT_TEST (see Kconfig and .kunitconfig).
+ *
+ * report bytes are spelled out like t6-uhid-bench does, not built from
+ * the driver's structs, so a layout change shows up here.
+ */
+
+#include <kunit/test.h>
+
+struct btp_t6_test {
+    struct hid_device hdev;
+    struct btp_t6_ctlr ctlr;
+};
+
+static const int btp_t6_test_abs[] = { ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ };
+
+// no fuzz, so every value the parser reports lands in absinfo
+static struct input_dev *btp_t6_test_input(struct kunit *test)
+{
+    struct input_dev *input = input_allocate_device();
+    int i, ret;
+
+    KUNIT_ASSERT_NOT_NULL(test, input);
+    input->name = "btp_t6 kunit";
+    for (i = 0; i < ARRAY_SIZE(btp_t6_test_abs); ++i)
+        input_set_abs_params(input, btp_t6_test_abs[i], S32_MIN, S32_MAX, 0, 0);
+    for (i = 0; i < T6_BTN_COUNT; ++i) {
+        if (btp_t6_default_keymap[i] != KEY_RESERVED)
+            input_set_capability(input, EV_KEY, btp_t6_default_keymap[i]);
+    }
+    input_set_capability(input, EV_MSC, MSC_TIMESTAMP);
+    ret = input_register_device(input);
+    if (ret)
+        input_free_device(input);
+    KUNIT_ASSERT_EQ(test, ret, 0);
+    return input;
+}
+
+static int btp_t6_test_init(struct kunit *test)
+{
+    struct btp_t6_test *t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+
+    if (!t)
+        return -ENOMEM;
+    t->ctlr.hdev = &t->hdev;
+    t->ctlr.product = &btp_t6_product_usb;
+    t->ctlr.imu_avg.decimation = 1;
+    memcpy(t->ctlr.keymap, btp_t6_default_keymap, sizeof(t->ctlr.keymap));
+    btp_t6_axis_init(&t->ctlr);
+    spin_lock_init(&t->ctlr.lock);
+    test->priv = t;
+    return 0;
+}
+
+static void btp_t6_test_exit(struct kunit *test)
+{
+    struct btp_t6_test *t = test->priv;
+
+    if (t->ctlr.input)
+        input_unregister_device(t->ctlr.input);
+    if (t->ctlr.imu_input)
+        input_unregister_device(t->ctlr.imu_input);
+}
+
+static void btp_t6_test_axis_default(struct kunit *test)
+{
+    struct btp_t6_ctlr *ctlr = &((struct btp_t6_test *)test->priv)->ctlr;
+
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LX][0x80], 0);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LX][0xff], 32767);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LX][0x01], -32767);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LX][0x00], -32767);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LX][0x40], -16512);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_RX][0xa0], 8256);
+    // y axes are upside down
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LY][0x00], 32767);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LY][0xff], -32767);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LY][0xc0], -16512);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_RY][0x60], 8256);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LT][0x00], 0);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_LT][0x40], 64);
+    KUNIT_EXPECT_EQ(test, ctlr->axis_lut[T6_AXIS_RT][0xff], 255);
+}
+
+static void btp_t6_test_axis_deadzone(struct kunit *test)
+{
+    struct btp_t6_ctlr *ctlr = &((struct btp_t6_test *)test->priv)->ctlr;
+    const s16 *lut = ctlr->axis_lut[T6_AXIS_LX];
+
+    ctlr->axis_cal[T6_AXIS_LX].inner = 100;
+    ctlr->axis_cal[T6_AXIS_LX].outer = 900;
+    btp_t6_axis_build(ctlr, T6_AXIS_LX);
+
+    // 12 / 127 is inside 10%, 115 / 127 is past 90%
+    KUNIT_EXPECT_EQ(test, lut[0x80 + 12], 0);
+    KUNIT_EXPECT_EQ(test, lut[0x80 - 12], 0);
+    KUNIT_EXPECT_GT(test, lut[0x80 + 14], 0);
+    KUNIT_EXPECT_LT(test, lut[0x80 - 14], 0);
+    KUNIT_EXPECT_EQ(test, lut[0x80 + 115], 32767);
+    KUNIT_EXPECT_EQ(test, lut[0x80 - 115], -32767);
+}
+
+static void btp_t6_test_axis_curves(struct kunit *test)
+{
+    struct btp_t6_ctlr *ctlr = &((struct btp_t6_test *)test->priv)->ctlr;
+    s16 linear[T6_AXIS_COUNT][256];
+    int curve, i, v;
+
+    memcpy(linear, ctlr->axis_lut, sizeof(linear));
+    for (curve = T6_AXIS_CURVE_SQUARE; curve <= T6_AXIS_CURVE_CUBE; ++curve) {
+        ctlr->axis_curve = curve;
+        for (i = 0; i < T6_AXIS_COUNT; ++i) {
+            const s16 *lut = ctlr->axis_lut[i];
+            int dir = i == T6_AXIS_LY || i == T6_AXIS_RY ? -1 : 1;
+
+            btp_t6_axis_build(ctlr, i);
+            KUNIT_EXPECT_EQ(test, lut[0], linear[i][0]);
+            KUNIT_EXPECT_EQ(test, lut[255], linear[i][255]);
+            for (v = 1; v < 256; ++v) {
+                KUNIT_EXPECT_GE(test, dir * lut[v], dir * lut[v - 1]);
+                KUNIT_EXPECT_LE(test, abs(lut[v]), abs(linear[i][v]));
+            }
+        }
+    }
+}
+
+static void btp_t6_test_clock_feed(struct btp_t6_clock *clk, u64 rx_ns,
+                u32 *last_us)
+{
+    btp_t6_clock_update(clk, ns_to_ktime(rx_ns));
+    *last_us = clk->timestamp_us;
+}
+
+static void btp_t6_test_clock_steady(struct kunit *test)
+{
+    struct btp_t6_clock clk = { };
+    u64 base = 5 * NSEC_PER_SEC, rx;
+    u32 last_us = 0, prev_us;
+    int i;
+
+    // 1ms reports with +-100us of usb jitter
+    for (i = 0; i < 4000; ++i) {
+        rx = base + i * NSEC_PER_MSEC + (i & 1 ? 100000 : -100000);
+        prev_us = last_us;
+        btp_t6_test_clock_feed(&clk, rx, &last_us);
+        if (i)
+            KUNIT_EXPECT_GT(test, last_us, prev_us);
+    }
+    KUNIT_EXPECT_EQ(test, clk.timestamp_us, (u32)div_u64(clk.t_ns - base + 100000, 1000));
+    KUNIT_EXPECT_LT(test, abs((s64)(clk.period_q8 >> 8) - NSEC_PER_MSEC), 2000);
+    KUNIT_EXPECT_LT(test, abs((s64)(clk.t_ns - base - 3999 * NSEC_PER_MSEC)), 50000);
+    KUNIT_EXPECT_LT(test, clk.jitter_ns, 250000);
+}
+
+static void btp_t6_test_clock_resync(struct kunit *test)
+{
+    struct btp_t6_clock clk = { };
+    u64 rx = NSEC_PER_SEC;
+    u32 last_us = 0, prev_us;
+    int i;
+
+    for (i = 0; i < 100; ++i, rx += NSEC_PER_MSEC)
+        btp_t6_test_clock_feed(&clk, rx, &last_us);
+
+    // a stall restarts the phase at the arrival time
+    rx += 50 * NSEC_PER_MSEC;
+    btp_t6_test_clock_feed(&clk, rx, &last_us);
+    KUNIT_EXPECT_EQ(test, clk.t_ns, rx);
+
+    // a burst never runs the timestamps backwards or stops them
+    for (i = 0; i < 32; ++i) {
+        prev_us = last_us;
+        btp_t6_test_clock_feed(&clk, rx + i * 1000, &last_us);
+        KUNIT_EXPECT_GT(test, clk.t_ns, rx);
+        KUNIT_EXPECT_GE(test, last_us, prev_us);
+    }
+}
+
+// report 5: sticks and triggers from byte 2, buttons 8-10, imu from byte 23
+static void btp_t6_test_report5(u8 *data, const u8 *axes, u32 btns,
+                const s16 *imu)
+{
+    memset(data, 0, 64);
+    data[0] = 5;
+    memcpy(data + 2, axes, 6);
+    data[8] = btns;
+    data[9] = btns >> 8;
+    data[10] = btns >> 16;
+    memcpy(data + 23, imu, 12);
+}
+
+// report 4: only the imu, from byte 2
+static void btp_t6_test_report4(u8 *data, const s16 *imu)
+{
+    memset(data, 0, 64);
+    data[0] = 4;
+    memcpy(data + 2, imu, 12);
+}
+
+static void btp_t6_test_expect_imu(struct kunit *test, struct input_dev *input,
+                const s16 *imu)
+{
+    KUNIT_EXPECT_EQ(test, input->absinfo[ABS_X].value, imu[0]);
+    KUNIT_EXPECT_EQ(test, input->absinfo[ABS_Y].value, imu[1]);
+    KUNIT_EXPECT_EQ(test, input->absinfo[ABS_Z].value, imu[2]);
+    KUNIT_EXPECT_EQ(test, input->absinfo[ABS_RX].value, imu[3] * 1000);
+    KUNIT_EXPECT_EQ(test, input->absinfo[ABS_RY].value, imu[4] * 1000);
+    KUNIT_EXPECT_EQ(test, input->absinfo[ABS_RZ].value, imu[5] * 1000);
+}
+
+static void btp_t6_test_parse_wired(struct kunit *test)
+{
+    struct btp_t6_ctlr *ctlr = &((struct btp_t6_test *)test->priv)->ctlr;
+    static const u8 axes[] = { 0xff, 0x00, 0x01, 0xff, 0xff, 0x80 };
+    static const s16 imu[] = { 1000, -2000, 3000, 100, -200, 300 };
+    static const s16 imu4[] = { -1000, 2000, 4096, -300, 0, 32767 };
+    u8 data[64];
+
+    ctlr->input = btp_t6_test_input(test);
+    ctlr->imu_input = btp_t6_test_input(test);
+
+    btp_t6_test_report5(data, axes, BIT(0) | BIT(12) | BIT(16), imu);
+    ctlr->rx_time = ktime_get();
+    btp_t6_parse_report(ctlr, ctlr->product->reports[5], data);
+
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_X].value, 32767);
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_Y].value, 32767);
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_RX].value, -32767);
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_RY].value, -32767);
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_Z].value, 255);
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_RZ].value, 128);
+    KUNIT_EXPECT_TRUE(test, test_bit(BTN_DPAD_UP, ctlr->input->key));
+    KUNIT_EXPECT_TRUE(test, test_bit(BTN_A, ctlr->input->key));
+    KUNIT_EXPECT_TRUE(test, test_bit(BTN_BASE, ctlr->input->key));
+    KUNIT_EXPECT_FALSE(test, test_bit(BTN_B, ctlr->input->key));
+    btp_t6_test_expect_imu(test, ctlr->imu_input, imu);
+
+    // report 4 only carries the imu, the gamepad keeps its state
+    btp_t6_test_report4(data, imu4);
+    ctlr->rx_time = ktime_add_ms(ctlr->rx_time, 1);
+    btp_t6_parse_report(ctlr, ctlr->product->reports[4], data);
+
+    btp_t6_test_expect_imu(test, ctlr->imu_input, imu4);
+    KUNIT_EXPECT_EQ(test, ctlr->input->absinfo[ABS_X].value, 32767);
+    KUNIT_EXPECT_TRUE(test, test_bit(BTN_A, ctlr->input->key));
+}
+
+static void btp_t6_test_parse_dropped(struct kunit *test)
+{
+    struct btp_t6_ctlr *ctlr = &((struct btp_t6_test *)test->priv)->ctlr;
+    static const u8 axes[] = { 0x80, 0x80, 0x80, 0x80, 0, 0 };
+    static const s16 imu[] = { 1, 2, 3, 4, 5, 6 };
+    u8 data[64];
+
+    ctlr->product = &btp_t6_product_adapter;
+    ctlr->imu_input = btp_t6_test_input(test);
+    ctlr->rx_time = ktime_get();
+
+    // declared by the adapter's descriptor, but it has no report 5 layout
+    btp_t6_test_report5(data, axes, 0, imu);
+    btp_t6_ctlr_read_handler(ctlr, data, 64);
+    KUNIT_EXPECT_EQ(test, ctlr->stats.unknown, 1);
+
+    btp_t6_test_report4(data, imu);
+    btp_t6_ctlr_read_handler(ctlr, data, 12);
+    KUNIT_EXPECT_EQ(test, ctlr->stats.short_reports, 1);
+    KUNIT_EXPECT_EQ(test, ctlr->stats.parsed, 0);
+    KUNIT_EXPECT_EQ(test, ctlr->imu_input->absinfo[ABS_X].value, 0);
+
+    btp_t6_ctlr_read_handler(ctlr, data, 32);
+    KUNIT_EXPECT_EQ(test, ctlr->stats.parsed, 1);
+    KUNIT_EXPECT_EQ(test, ctlr->stats.reports, 3);
+    btp_t6_test_expect_imu(test, ctlr->imu_input, imu);
+}
+
+/*
+ * not a check of the output: times golden reports 4 and 5 through
+ * btp_t6_parse_report. unlike parse avg in debugfs this leaves out the
+ * lock, the stats and the wait between arrival and the handler.
+ * two alternating reports per id, so every call has events to send.
+ */
+#define T6_TEST_BENCH_LOOPS 20000
+
+static void btp_t6_test_parse_bench(struct kunit *test)
+{
+    struct btp_t6_ctlr *ctlr = &((struct btp_t6_test *)test->priv)->ctlr;
+    static const u8 axes[2][6] = {
+        { 0xff, 0x00, 0x01, 0xff, 0xff, 0x80 },
+        { 0x40, 0xc0, 0x80, 0x20, 0x00, 0x10 },
+    };
+    static const s16 imu[2][6] = {
+        { 1000, -2000, 3000, 100, -200, 300 },
+        { -1000, 2000, 4096, -300, 0, 32767 },
+    };
+    static const int ids[] = { 5, 4 };
+    u8 data[2][64];
+    u64 start, ns;
+    int i, j;
+
+    ctlr->input = btp_t6_test_input(test);
+    ctlr->imu_input = btp_t6_test_input(test);
+    ctlr->rx_time = ktime_get();
+
+    for (j = 0; j < ARRAY_SIZE(ids); ++j) {
+        for (i = 0; i < 2; ++i) {
+            if (ids[j] == 5)
+                btp_t6_test_report5(data[i], axes[i], BIT(i), imu[i]);
+            else
+                btp_t6_test_report4(data[i], imu[i]);
+        }
+
+        start = ktime_get_ns();
+        for (i = 0; i < T6_TEST_BENCH_LOOPS; ++i) {
+            ctlr->rx_time = ktime_add_ms(ctlr->rx_time, 1);
+            btp_t6_parse_report(ctlr, ctlr->product->reports[ids[j]], data[i & 1]);
+        }
+        ns = ktime_get_ns() - start;
+
+        kunit_info(test, "report %d: %llu ns per report over %d reports\n", ids[j],
+            div_u64(ns, T6_TEST_BENCH_LOOPS), T6_TEST_BENCH_LOOPS);
+        btp_t6_test_expect_imu(test, ctlr->imu_input, imu[(T6_TEST_BENCH_LOOPS - 1) & 1]);
+    }
+}
+
+static struct kunit_case btp_t6_test_cases[] = {
+    KUNIT_CASE(btp_t6_test_axis_default),
+    KUNIT_CASE(btp_t6_test_axis_deadzone),
+    KUNIT_CASE(btp_t6_test_axis_curves),
+    KUNIT_CASE(btp_t6_test_clock_steady),
+    KUNIT_CASE(btp_t6_test_clock_resync),
+    KUNIT_CASE(btp_t6_test_parse_wired),
+    KUNIT_CASE(btp_t6_test_parse_dropped),
+    KUNIT_CASE(btp_t6_test_parse_bench),
+    { }
+};
+
+static struct kunit_suite btp_t6_test_suite = {
+    .name = "hid-betop-t6",
+    .init = btp_t6_test_init,
+    .exit = btp_t6_test_exit,
+    .test_cases = btp_t6_test_cases,
+};
+kunit_test_suite(btp_t6_test_suite);
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * tracepoints along the report path of hid-betop-t6.
+ * devices are identified by the hid device id, the number after the
+ * dot in /sys/bus/hid/devices/0003:20BC:500C.0001.
+ * delays are ns since the report reached btp_t6_hid_event, they are only
+ * computed when the event is enabled.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM btp_t6
+
+#if !defined(_HID_BETOP_T6_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HID_BETOP_T6_TRACE_H
+
+#include <linux/ktime.h>
+#include <linux/tracepoint.h>
+
+#ifndef _HID_BETOP_T6_TRACE_CONSTS
+#define _HID_BETOP_T6_TRACE_CONSTS
+
+#define T6_TRACE_STAGE_CTLR         0
+#define T6_TRACE_STAGE_IMU          1
+#define T6_TRACE_STAGE_ORIENT       2
+#define T6_TRACE_STAGE_IIO          3
+
+#define T6_TRACE_INPUT_CTLR         0
+#define T6_TRACE_INPUT_IMU          1
+
+#define T6_TRACE_DROP_NOT_READY     0
+#define T6_TRACE_DROP_SHORT         1
+#define T6_TRACE_DROP_UNKNOWN       2
+#define T6_TRACE_DROP_IDLE          3
+
+#endif
+
+TRACE_EVENT(btp_t6_report,
+    TP_PROTO(unsigned int hid, u8 id, int size, ktime_t rx),
+    TP_ARGS(hid, id, size, rx),
+    TP_STRUCT__entry(
+        __field(unsigned int, hid)
+        __field(u8, id)
+        __field(int, size)
+        __field(s64, rx_ns)
+    ),
+    TP_fast_assign(
+        __entry->hid = hid;
+        __entry->id = id;
+        __entry->size = size;
+        __entry->rx_ns = ktime_to_ns(rx);
+    ),
+    TP_printk("hid=%04x id=%u size=%d rx_ns=%lld",
+        __entry->hid, __entry->id, __entry->size, __entry->rx_ns)
+);
+
+TRACE_EVENT(btp_t6_parse,
+    TP_PROTO(unsigned int hid, int stage, ktime_t rx),
+    TP_ARGS(hid, stage, rx),
+    TP_STRUCT__entry(
+        __field(unsigned int, hid)
+        __field(int, stage)
+        __field(s64, delay_ns)
+    ),
+    TP_fast_assign(
+        __entry->hid = hid;
+        __entry->stage = stage;
+        __entry->delay_ns = ktime_to_ns(ktime_sub(ktime_get(), rx));
+    ),
+    TP_printk("hid=%04x stage=%s delay_ns=%lld",
+        __entry->hid,
+        __print_symbolic(__entry->stage,
+            { T6_TRACE_STAGE_CTLR, "controller" },
+            { T6_TRACE_STAGE_IMU, "imu" },
+            { T6_TRACE_STAGE_ORIENT, "orientation" },
+            { T6_TRACE_STAGE_IIO, "iio" }),
+        __entry->delay_ns)
+);
+
+TRACE_EVENT(btp_t6_sync,
+    TP_PROTO(unsigned int hid, int input, ktime_t rx),
+    TP_ARGS(hid, input, rx),
+    TP_STRUCT__entry(
+        __field(unsigned int, hid)
+        __field(int, input)
+        __field(s64, delay_ns)
+    ),
+    TP_fast_assign(
+        __entry->hid = hid;
+        __entry->input = input;
+        __entry->delay_ns = ktime_to_ns(ktime_sub(ktime_get(), rx));
+    ),
+    TP_printk("hid=%04x input=%s delay_ns=%lld",
+        __entry->hid,
+        __print_symbolic(__entry->input,
+            { T6_TRACE_INPUT_CTLR, "controller" },
+            { T6_TRACE_INPUT_IMU, "imu" }),
+        __entry->delay_ns)
+);
+
+TRACE_EVENT(btp_t6_drop,
+    TP_PROTO(unsigned int hid, u8 id, int size, int reason),
+    TP_ARGS(hid, id, size, reason),
+    TP_STRUCT__entry(
+        __field(unsigned int, hid)
+        __field(u8, id)
+        __field(int, size)
+        __field(int, reason)
+    ),
+    TP_fast_assign(
+        __entry->hid = hid;
+        __entry->id = id;
+        __entry->size = size;
+        __entry->reason = reason;
+    ),
+    TP_printk("hid=%04x id=%u size=%d reason=%s",
+        __entry->hid, __entry->id, __entry->size,
+        __print_symbolic(__entry->reason,
+            { T6_TRACE_DROP_NOT_READY, "not_ready" },
+            { T6_TRACE_DROP_SHORT, "short" },
+            { T6_TRACE_DROP_UNKNOWN, "unknown" },
+            { T6_TRACE_DROP_IDLE, "idle" }))
+);
+
+#endif /* _HID_BETOP_T6_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hid-betop-t6-trace
+#include <trace/define_trace.h>
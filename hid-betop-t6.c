@@ -11,13 +11,37 @@
  */
 
 #include "hid-ids.h"
+#include "hid-betop-t6-ring.h"
 
 #include <linux/module.h>
 #include <linux/hid.h>
 #include <linux/input.h>
 #include <linux/input-event-codes.h>
+#include <linux/device.h>
+#include <linux/iio/iio.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/kfifo_buf.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
 #include <asm-generic/errno-base.h>
-#include <linux/jiffies.h>
+
+#define CREATE_TRACE_POINTS
+#include "hid-betop-t6-trace.h"
 
 /*
  * constants for input parameter,
@@ -34,6 +58,46 @@ static const u16 T6_TRIGGER_MAX         = 255;
 static const u16 T6_TRIGGER_FUZZ        = 0;
 static const u16 T6_TRIGGER_FLAT        = 0;
 
+/*
+ * sticks and triggers go through a 256 entry table per axis, built
+ * from the calibration whenever it changes. sticks are scaled from
+ * center to min/max separately, triggers from min to max. deadzones
+ * are in 1/1000 of the travel, the curve is applied after them.
+ */
+static const unsigned int T6_AXIS_DEADZONE_MAX = 1000;
+static const unsigned int T6_AXIS_ONE_SHIFT = 16;
+
+enum btp_t6_axis {
+    T6_AXIS_LX,
+    T6_AXIS_LY,
+    T6_AXIS_RX,
+    T6_AXIS_RY,
+    T6_AXIS_LT,
+    T6_AXIS_RT,
+    T6_AXIS_COUNT,
+};
+
+static const char * const btp_t6_axis_names[] = {
+    [T6_AXIS_LX] = "lx",
+    [T6_AXIS_LY] = "ly",
+    [T6_AXIS_RX] = "rx",
+    [T6_AXIS_RY] = "ry",
+    [T6_AXIS_LT] = "lt",
+    [T6_AXIS_RT] = "rt",
+};
+
+enum btp_t6_axis_curve {
+    T6_AXIS_CURVE_LINEAR,
+    T6_AXIS_CURVE_SQUARE,
+    T6_AXIS_CURVE_CUBE,
+};
+
+static const char * const btp_t6_axis_curve_names[] = {
+    [T6_AXIS_CURVE_LINEAR]  = "linear",
+    [T6_AXIS_CURVE_SQUARE]  = "square",
+    [T6_AXIS_CURVE_CUBE]    = "cube",
+};
+
 /*
  * according hid-nintendo, RES stands for digits per G,
  * which on my observation, is also about 4k.
@@ -60,35 +124,172 @@ static const u16 T6_IMU_GYRO_RES        = 16383;
  * according to https://github.com/ValveSoftware/steamos_kernel/commit/76e4b04b93b40db186d0c4bbbd1824f5d98c76a9
  * M1 - M4 are mapped to BTN_BASE - BTN_BASE4
  * will keep an eye on steamos3
+ *
+ * this is only the default, it's the keycode table of the input device,
+ * so it can be remapped with EVIOCSKEYCODE (udev hwdb does that)
+ * or through the keymap attribute.
  */
-static const u32 T6_BTN_UP              = BIT(0);
-static const u32 T6_BTN_DOWN            = BIT(1);
-static const u32 T6_BTN_LEFT            = BIT(2);
-static const u32 T6_BTN_RIGHT           = BIT(3);
-static const u32 T6_BTN_START           = BIT(4);
-static const u32 T6_BTN_SELECT          = BIT(5);
-static const u32 T6_BTN_LSTICK          = BIT(6);
-static const u32 T6_BTN_RSTICK          = BIT(7);
-static const u32 T6_BTN_LB              = BIT(8);
-static const u32 T6_BTN_RB              = BIT(9);
-//static const u32 T6_BTN_                = BIT(10);
-//static const u32 T6_BTN_                = BIT(11);
-static const u32 T6_BTN_A               = BIT(12);
-static const u32 T6_BTN_B               = BIT(13);
-static const u32 T6_BTN_X               = BIT(14);
-static const u32 T6_BTN_Y               = BIT(15);
-static const u32 T6_BTN_M1              = BIT(16);
-static const u32 T6_BTN_M2              = BIT(17);
-static const u32 T6_BTN_M3              = BIT(18);
-static const u32 T6_BTN_M4              = BIT(19);
-
-static const unsigned int btp_t6_buttons[] = {
-    BTN_BASE, BTN_BASE2, BTN_BASE3, BTN_BASE4,
-    BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST,
-    BTN_TL, BTN_TR, //BTN_TL2, BTN_TR2,
-    BTN_SELECT, BTN_START, BTN_THUMBL, BTN_THUMBR,
+#define T6_BTN_COUNT 24
+
+static const u16 btp_t6_default_keymap[T6_BTN_COUNT] = {
     BTN_DPAD_UP, BTN_DPAD_DOWN, BTN_DPAD_LEFT, BTN_DPAD_RIGHT,
+    BTN_START, BTN_SELECT, BTN_THUMBL, BTN_THUMBR,
+    BTN_TL, BTN_TR, KEY_RESERVED, KEY_RESERVED,
+    BTN_A, BTN_B, BTN_X, BTN_Y,
+    BTN_BASE, BTN_BASE2, BTN_BASE3, BTN_BASE4,
+};
+
+/*
+ * the controller doesn't put any counter into its reports, so the only
+ * time reference is the moment a report reaches btp_t6_hid_event.
+ * usb scheduling adds quite some jitter on top of that, a small pll
+ * smooths it out: the period estimate follows the average inter-arrival
+ * time slowly, the phase follows the arrival time a bit faster.
+ * gains are powers of two so the hot path only shifts.
+ */
+static const unsigned int T6_CLOCK_PHASE_SHIFT      = 4;
+static const unsigned int T6_CLOCK_PERIOD_SHIFT     = 8;
+static const unsigned int T6_CLOCK_JITTER_SHIFT     = 4;
+static const unsigned int T6_CLOCK_RESYNC_PERIODS   = 8;
+
+/*
+ * imu output can be slowed down for consumers that don't need every
+ * sample, N reports are averaged into one frame. boxcar is the plain
+ * mean of the N samples, iir is a first order low pass with 1/N gain
+ * that is sampled every N reports.
+ */
+static const unsigned int T6_IMU_DECIMATION_MAX = 64;
+
+enum btp_t6_imu_filter {
+    T6_IMU_FILTER_BOXCAR,
+    T6_IMU_FILTER_IIR,
+};
+
+static const char * const btp_t6_imu_filter_names[] = {
+    [T6_IMU_FILTER_BOXCAR]  = "boxcar",
+    [T6_IMU_FILTER_IIR]     = "iir",
+};
+
+/*
+ * optional adaptive smoothing, one euro style: a first order low pass per
+ * axis whose cutoff grows with how fast the axis moves, so there's heavy
+ * smoothing at rest and next to no lag on fast motion. it replaces the
+ * input core's fuzz, which either lets jitter through or eats small moves.
+ * min_cutoff is in mHz, 0 turns it off. beta adds cutoff for speed, in
+ * uHz per digit/s, digits being what the axis reports (sticks after the
+ * axis table, imu raw with the gyro bias removed). the speed is low passed
+ * at T6_SMOOTH_D_CUTOFF mHz, T6_SMOOTH_2PI_Q16 is 2 pi in q16.
+ */
+static const unsigned int T6_SMOOTH_CUTOFF_MAX      = 1000000;
+static const unsigned int T6_SMOOTH_D_CUTOFF        = 1000;
+static const u64 T6_SMOOTH_2PI_Q16                  = 411775;
+static const unsigned int T6_SMOOTH_PERIOD_SHIFT    = 3;
+static const u64 T6_SMOOTH_GAP_MAX_NS               = 50 * NSEC_PER_MSEC;
+
+/*
+ * gyro zero rate offset tracking.
+ * samples are collected in windows of 2^T6_BIAS_WINDOW_SHIFT, a window
+ * where both accel and gyro barely move counts as still and its gyro
+ * mean is blended into the bias. the first still window sets the bias,
+ * after that the gain drops to 1/T6_BIAS_GAIN_MIN so it keeps following
+ * temperature drift. variances are in digits^2.
+ * a slow constant spin around the gravity axis also looks still,
+ * that's what T6_BIAS_GYRO_MEAN_MAX is for.
+ */
+static const unsigned int T6_BIAS_WINDOW_SHIFT      = 5;
+static const s64 T6_BIAS_GYRO_VAR_MAX               = 64;
+static const s64 T6_BIAS_ACCEL_VAR_MAX              = 256;
+static const s32 T6_BIAS_GYRO_MEAN_MAX              = 256;
+static const unsigned int T6_BIAS_GAIN_MIN          = 16;
+static const unsigned int T6_BIAS_CONFIDENCE_MAX    = 100;
+
+/*
+ * optional orientation device, a fixed point mahony filter fed with the
+ * compensated samples. the gyro bias is already gone at that point,
+ * so there's no integral term, only the proportional accel feedback.
+ * quaternion is q30 inside, reported as q14:
+ * ABS_X/ABS_Y/ABS_Z are x/y/z, ABS_MISC is w.
+ * T6_FUSION_GYRO_Q24 is rad/s per gyro digit (2000 deg/s full scale) in q24,
+ * gain is kp in 1/1000, boosted for a while after a reset to converge fast.
+ */
+static bool orientation;
+module_param(orientation, bool, 0444);
+MODULE_PARM_DESC(orientation, "Register an extra input device reporting fused orientation");
+
+static const s64 T6_FUSION_GYRO_Q24         = 17874;
+static const unsigned int T6_FUSION_GAIN    = 500;
+static const unsigned int T6_FUSION_GAIN_MAX = 20000;
+static const unsigned int T6_FUSION_INIT_SAMPLES = 256;
+static const unsigned int T6_FUSION_INIT_BOOST = 10;
+static const u64 T6_FUSION_DT_MAX_NS        = 50 * NSEC_PER_MSEC;
+static const s32 T6_ORIENT_MAX              = 16384;
+
+static const unsigned int btp_t6_orientation[] = {
+    ABS_X, ABS_Y, ABS_Z, ABS_MISC,
+};
+
+#if IS_REACHABLE(CONFIG_IIO_KFIFO_BUF)
+/*
+ * the same samples through iio, for readers that want them in bulk.
+ * samples come from the report handler, so they are pushed straight
+ * into a kfifo, no trigger involved.
+ * scales are derived from the input resolutions:
+ * accel RES digits per g, gyro RES per 1000 deg/s (that's why the
+ * evdev gyro values are multiplied by 1000).
+ */
+static const u64 T6_IIO_G_NANO              = 9806650000ULL;
+static const u64 T6_IIO_DEG_NANORAD         = 17453293ULL;
+
+#define BTP_T6_IIO_CHAN(_type, _mod, _index) {                  \
+    .type = _type,                                              \
+    .modified = 1,                                              \
+    .channel2 = _mod,                                           \
+    .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),               \
+    .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),       \
+    .info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),    \
+    .scan_index = _index,                                       \
+    .scan_type = {                                              \
+        .sign = 's',                                            \
+        .realbits = 16,                                         \
+        .storagebits = 16,                                      \
+        .endianness = IIO_CPU,                                  \
+    },                                                          \
+}
+
+static const struct iio_chan_spec btp_t6_iio_channels[] = {
+    BTP_T6_IIO_CHAN(IIO_ACCEL, IIO_MOD_X, 0),
+    BTP_T6_IIO_CHAN(IIO_ACCEL, IIO_MOD_Y, 1),
+    BTP_T6_IIO_CHAN(IIO_ACCEL, IIO_MOD_Z, 2),
+    BTP_T6_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_X, 3),
+    BTP_T6_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_Y, 4),
+    BTP_T6_IIO_CHAN(IIO_ANGL_VEL, IIO_MOD_Z, 5),
+    IIO_CHAN_SOFT_TIMESTAMP(6),
+};
+
+// always push everything, the iio core demuxes what's enabled
+static const unsigned long btp_t6_iio_scan_masks[] = {
+    GENMASK(5, 0), 0,
 };
+#endif
+
+/*
+ * a read only mmap of raw imu samples for consumers that poll at their
+ * own rate, layout and protocol in hid-betop-t6-ring.h.
+ * the header sits in the first cache line, the samples follow.
+ */
+static bool imu_ring;
+module_param(imu_ring, bool, 0444);
+MODULE_PARM_DESC(imu_ring, "Register /dev/betop-t6-imu<hid id>, an mmap-able ring of imu samples");
+
+#define T6_RING_DATA_OFFSET 64
+
+/*
+ * report counters, kept in the hot path, read through debugfs.
+ * inter-arrival times go to log2 buckets from 1us (2^10 ns) to 1s.
+ */
+#define T6_STATS_IDS 16
+#define T6_STATS_HIST_MIN_SHIFT 10
+#define T6_STATS_HIST_BUCKETS 21
 
 static const unsigned int btp_t6_sticks[] = {
     ABS_X, ABS_Y, ABS_RX, ABS_RY,
@@ -148,140 +349,1394 @@ struct btp_t6_input_data5 {
     u8 padding3[13+16];
 };
 
-struct btp_t6_input_report {
-    u8 id;
-    union {
-        struct btp_t6_input_data4 data4;
-        struct btp_t6_input_data5 data5;
-    };
-};
+struct btp_t6_input_report {
+    u8 id;
+    union {
+        struct btp_t6_input_data4 data4;
+        struct btp_t6_input_data5 data5;
+    };
+};
+
+/*
+ * what each report id carries, picked per product at probe.
+ * offsets are from the start of the report, id included,
+ * -1 when the report doesn't have that block.
+ */
+#define T6_REPORT_IDS 8
+
+struct btp_t6_report_layout {
+    u8 size;
+    s8 ctlr;
+    s8 imu;
+};
+
+struct btp_t6_product {
+    const char *name;
+    const char *imu_name;
+    const char *orient_name;
+    const struct btp_t6_report_layout *reports[T6_REPORT_IDS];
+};
+
+static const struct btp_t6_report_layout btp_t6_layout4 = {
+    .size   = 32,
+    .ctlr   = -1,
+    .imu    = offsetof(struct btp_t6_input_report, data4.raw_imu),
+};
+
+static const struct btp_t6_report_layout btp_t6_layout5 = {
+    .size   = 64,
+    .ctlr   = offsetof(struct btp_t6_input_report, data5.raw_ctlr),
+    .imu    = offsetof(struct btp_t6_input_report, data5.raw_imu),
+};
+
+// only get report id 5 when wired, sad
+static const struct btp_t6_product btp_t6_product_usb = {
+    .name           = "Betop T6 For USB",
+    .imu_name       = "Betop T6 For USB IMU",
+    .orient_name    = "Betop T6 For USB Orientation",
+    .reports        = { [4] = &btp_t6_layout4, [5] = &btp_t6_layout5 },
+};
+
+static const struct btp_t6_product btp_t6_product_adapter = {
+    .name           = "Betop T6 For Adapter",
+    .imu_name       = "Betop T6 For Adapter IMU",
+    .orient_name    = "Betop T6 For Adapter Orientation",
+    .reports        = { [4] = &btp_t6_layout4 },
+};
+
+static const struct btp_t6_product btp_t6_product_usb_audio = {
+    .name           = "Betop T6 For USB With Audio",
+    .imu_name       = "Betop T6 For USB With Audio IMU",
+    .orient_name    = "Betop T6 For USB With Audio Orientation",
+    .reports        = { [4] = &btp_t6_layout4, [5] = &btp_t6_layout5 },
+};
+
+static const struct btp_t6_product btp_t6_product_adapter_audio = {
+    .name           = "Betop T6 For Adapter With Audio",
+    .imu_name       = "Betop T6 For Adapter With Audio IMU",
+    .orient_name    = "Betop T6 For Adapter With Audio Orientation",
+    .reports        = { [4] = &btp_t6_layout4 },
+};
+
+struct btp_t6_axis_cal {
+    int min;
+    int center;
+    int max;
+    int inner;
+    int outer;
+};
+
+/*
+ * period_q8 is in ns << 8 for sub-ns tracking,
+ * timestamp_us is what goes to MSC_TIMESTAMP, it wraps at 32 bits
+ * like every other driver's.
+ */
+struct btp_t6_clock {
+    unsigned int samples;
+    u64 base_ns;
+    u64 rx_ns;
+    u64 t_ns;
+    s64 period_q8;
+    u64 jitter_ns;
+    u32 timestamp_us;
+};
+
+#define T6_IMU_AXES 6
+
+/*
+ * iir state is in 1/256 digit.
+ */
+struct btp_t6_imu_avg {
+    unsigned int decimation;
+    enum btp_t6_imu_filter filter;
+    unsigned int count;
+    bool primed;
+    u32 first_us;
+    s32 acc[T6_IMU_AXES];
+};
+
+/*
+ * bias is in 1/256 digit,
+ * confidence is the number of still windows seen, saturated.
+ */
+struct btp_t6_gyro_bias {
+    bool enabled;
+    unsigned int count;
+    s32 sum[T6_IMU_AXES];
+    s64 sumsq[T6_IMU_AXES];
+    s32 bias_q8[3];
+    unsigned int confidence;
+};
+
+/*
+ * x is the output in 1/256 digit, dx the filtered speed in digits/s.
+ * period_ns follows the arrival interval of this stream, cost_ns and
+ * lag_ns are running averages of one update and of the delay the filter
+ * adds on the fastest moving axis.
+ */
+struct btp_t6_smooth {
+    unsigned int min_cutoff;
+    unsigned int beta;
+    bool primed;
+    u64 last_rx_ns;
+    u64 period_ns;
+    s32 x_q8[T6_IMU_AXES];
+    s32 dx[T6_IMU_AXES];
+    u64 cost_ns;
+    u64 lag_ns;
+};
+
+/*
+ * q is w x y z in q30, cost_ns is a running average of one update.
+ */
+struct btp_t6_fusion {
+    s32 q[4];
+    unsigned int gain;
+    unsigned int init_samples;
+    u64 last_t_ns;
+    u64 cost_ns;
+};
+
+struct btp_t6_iio_scan {
+    s16 imu[T6_IMU_AXES];
+    s64 timestamp __aligned(8);
+};
+
+struct btp_t6_stats {
+    u64 reports;
+    u64 ids[T6_STATS_IDS];
+    u64 unknown;
+    u64 short_reports;
+    u64 not_ready;
+    u64 idle;
+    u64 parsed;
+    u64 parse_ns_sum;
+    u64 parse_ns_max;
+    u64 last_rx_ns;
+    u64 hist[T6_STATS_HIST_BUCKETS];
+};
+
+/*
+ * refcounted apart from the controller, open files and mappings
+ * can outlive remove(). ctlr is cleared under lock on remove.
+ */
+struct btp_t6_ring {
+    struct kref ref;
+    struct miscdevice misc;
+    char name[32];
+    struct mutex lock;
+    struct btp_t6_ctlr *ctlr;
+    bool removed;
+    wait_queue_head_t wait;
+    struct btp_t6_ring_header *hdr;
+    struct btp_t6_ring_sample *slots;
+    u64 head;
+};
+
+struct btp_t6_ring_reader {
+    struct btp_t6_ring *ring;
+    u64 seen;
+    u32 watermark;
+};
+
+enum btp_t6_ctlr_state {
+    T6_CTLR_STATE_INIT,
+    T6_CTLR_STATE_READ,
+    T6_CTLR_STATE_REMOVED,
+};
+
+struct btp_t6_ctlr {
+    enum btp_t6_ctlr_state state;
+    struct hid_device *hdev;
+    const struct btp_t6_product *product;
+    struct input_dev *input;
+    struct input_dev *imu_input;
+    struct input_dev *orient_input;
+    struct iio_dev *indio_dev;
+    struct dentry *debugfs;
+    struct btp_t6_ring *ring;
+    struct mutex io_lock;
+    unsigned int io_users;
+    bool io_removed;
+    spinlock_t lock;
+    ktime_t rx_time;
+    struct btp_t6_clock clock;
+    u16 keymap[T6_BTN_COUNT];
+    u32 last_btns;
+    struct btp_t6_axis_cal axis_cal[T6_AXIS_COUNT];
+    enum btp_t6_axis_curve axis_curve;
+    s16 axis_lut[T6_AXIS_COUNT][256];
+    struct btp_t6_imu_avg imu_avg;
+    struct btp_t6_gyro_bias gyro_bias;
+    struct btp_t6_smooth stick_smooth;
+    struct btp_t6_smooth imu_smooth;
+    struct btp_t6_fusion fusion;
+    struct btp_t6_iio_scan iio_scan;
+    struct btp_t6_stats stats;
+};
+
+// t and the result are in 1 << T6_AXIS_ONE_SHIFT
+static s64 btp_t6_axis_shape(const struct btp_t6_axis_cal *cal,
+                enum btp_t6_axis_curve curve, s64 t)
+{
+    const s64 one = 1 << T6_AXIS_ONE_SHIFT;
+    s64 inner = div_s64(cal->inner * one, T6_AXIS_DEADZONE_MAX);
+    s64 outer = div_s64(cal->outer * one, T6_AXIS_DEADZONE_MAX);
+
+    if (t <= inner)
+        return 0;
+    if (t >= outer)
+        return one;
+    t = div64_s64((t - inner) << T6_AXIS_ONE_SHIFT, outer - inner);
+
+    switch (curve) {
+    case T6_AXIS_CURVE_SQUARE:
+        t = (t * t) >> T6_AXIS_ONE_SHIFT;
+        break;
+    case T6_AXIS_CURVE_CUBE:
+        t = (((t * t) >> T6_AXIS_ONE_SHIFT) * t) >> T6_AXIS_ONE_SHIFT;
+        break;
+    default:
+        break;
+    }
+    return t;
+}
+
+static void btp_t6_axis_build(struct btp_t6_ctlr *ctlr, enum btp_t6_axis axis)
+{
+    const struct btp_t6_axis_cal *cal = &ctlr->axis_cal[axis];
+    const s64 one = 1 << T6_AXIS_ONE_SHIFT;
+    s16 *lut = ctlr->axis_lut[axis];
+    s64 t;
+    int v, d;
+
+    for (v = 0; v < 256; ++v) {
+        if (axis >= T6_AXIS_LT) {
+            t = div_s64(clamp(v - cal->min, 0, cal->max - cal->min) * one,
+                cal->max - cal->min);
+            lut[v] = (btp_t6_axis_shape(cal, ctlr->axis_curve, t) *
+                T6_TRIGGER_MAX + one / 2) >> T6_AXIS_ONE_SHIFT;
+            continue;
+        }
+
+        d = v - cal->center;
+        if (d >= 0)
+            t = div_s64(min(d, cal->max - cal->center) * one, cal->max - cal->center);
+        else
+            t = div_s64(min(-d, cal->center - cal->min) * one, cal->center - cal->min);
+        t = (btp_t6_axis_shape(cal, ctlr->axis_curve, t) * T6_STICK_MAG +
+            one / 2) >> T6_AXIS_ONE_SHIFT;
+        // y axes are upside down
+        if ((d < 0) != (axis == T6_AXIS_LY || axis == T6_AXIS_RY))
+            t = -t;
+        lut[v] = t;
+    }
+}
+
+static void btp_t6_axis_init(struct btp_t6_ctlr *ctlr)
+{
+    int i;
+
+    for (i = 0; i < T6_AXIS_COUNT; ++i) {
+        struct btp_t6_axis_cal *cal = &ctlr->axis_cal[i];
+
+        cal->min = i >= T6_AXIS_LT ? 0 : T6_STICK_CENTER - T6_STICK_MAX;
+        cal->center = T6_STICK_CENTER;
+        cal->max = i >= T6_AXIS_LT ? T6_TRIGGER_MAX : T6_STICK_CENTER + T6_STICK_MAX;
+        cal->inner = 0;
+        cal->outer = T6_AXIS_DEADZONE_MAX;
+        btp_t6_axis_build(ctlr, i);
+    }
+}
+
+/*
+ * feed one arrival time into the pll.
+ * the recovered time never moves by less than half a period,
+ * so the timestamps stay monotonic whatever usb does.
+ */
+static void btp_t6_clock_update(struct btp_t6_clock *clk, ktime_t rx)
+{
+    u64 rx_ns = ktime_to_ns(rx);
+    s64 period, err, corr;
+
+    if (clk->samples < 2) {
+        if (clk->samples == 0)
+            clk->base_ns = rx_ns;
+        else
+            clk->period_q8 = (rx_ns - clk->rx_ns) << 8;
+        clk->t_ns = rx_ns;
+        goto out;
+    }
+
+    period = clk->period_q8 >> 8;
+    err = (s64)(rx_ns - clk->t_ns) - period;
+
+    // a stall or a burst longer than a few periods, just restart the phase
+    if (period <= 0 || err > period * T6_CLOCK_RESYNC_PERIODS ||
+        err < -period * T6_CLOCK_RESYNC_PERIODS) {
+        if (period <= 0)
+            clk->period_q8 = (rx_ns - clk->rx_ns) << 8;
+        clk->t_ns = max(rx_ns, clk->t_ns + 1);
+        goto out;
+    }
+
+    corr = clamp_t(s64, err >> T6_CLOCK_PHASE_SHIFT, -period / 2, period / 2);
+    clk->t_ns += period + corr;
+    clk->period_q8 += err << (8 - T6_CLOCK_PERIOD_SHIFT);
+    clk->jitter_ns += (abs(err) - (s64)clk->jitter_ns) >> T6_CLOCK_JITTER_SHIFT;
+
+out:
+    clk->rx_ns = rx_ns;
+    clk->timestamp_us = (u32)div_u64(clk->t_ns - clk->base_ns, 1000);
+    if (clk->samples < 2)
+        ++clk->samples;
+}
+
+static void btp_t6_report_imu(struct btp_t6_ctlr *ctlr,
+                const s32 *imu, u32 timestamp_us)
+{
+    struct input_dev *imu_input = ctlr->imu_input;
+
+    input_event(imu_input, EV_MSC, MSC_TIMESTAMP, timestamp_us);
+    input_report_abs(imu_input, ABS_X, imu[0]);
+    input_report_abs(imu_input, ABS_Y, imu[1]);
+    input_report_abs(imu_input, ABS_Z, imu[2]);
+    input_report_abs(imu_input, ABS_RX, imu[3] * 1000);
+    input_report_abs(imu_input, ABS_RY, imu[4] * 1000);
+    input_report_abs(imu_input, ABS_RZ, imu[5] * 1000);
+}
+
+/*
+ * returns true when a frame is ready, the caller syncs.
+ * a boxcar frame is stamped in the middle of its window,
+ * that's where the averaged data is centered.
+ */
+static bool btp_t6_imu_decimate(struct btp_t6_ctlr *ctlr, s32 *imu)
+{
+    struct btp_t6_imu_avg *avg = &ctlr->imu_avg;
+    u32 now_us = ctlr->clock.timestamp_us;
+    int i, n = avg->decimation;
+
+    if (n <= 1) {
+        btp_t6_report_imu(ctlr, imu, now_us);
+        return true;
+    }
+
+    if (avg->filter == T6_IMU_FILTER_IIR) {
+        for (i = 0; i < T6_IMU_AXES; ++i) {
+            if (!avg->primed)
+                avg->acc[i] = imu[i] * 256;
+            else
+                avg->acc[i] += (imu[i] * 256 - avg->acc[i]) / n;
+        }
+        avg->primed = true;
+    } else {
+        if (!avg->count) {
+            memset(avg->acc, 0, sizeof(avg->acc));
+            avg->first_us = now_us;
+        }
+        for (i = 0; i < T6_IMU_AXES; ++i)
+            avg->acc[i] += imu[i];
+    }
+
+    if (++avg->count < n)
+        return false;
+    avg->count = 0;
+
+    if (avg->filter == T6_IMU_FILTER_IIR) {
+        for (i = 0; i < T6_IMU_AXES; ++i)
+            imu[i] = DIV_ROUND_CLOSEST(avg->acc[i], 256);
+    } else {
+        for (i = 0; i < T6_IMU_AXES; ++i)
+            imu[i] = DIV_ROUND_CLOSEST(avg->acc[i], n);
+        now_us = avg->first_us + (now_us - avg->first_us) / 2;
+    }
+    btp_t6_report_imu(ctlr, imu, now_us);
+    return true;
+}
+
+static void btp_t6_gyro_bias_window(struct btp_t6_gyro_bias *gb)
+{
+    const s64 n = 1 << T6_BIAS_WINDOW_SHIFT;
+    unsigned int gain;
+    int i;
+
+    // n * var = sumsq - sum^2 / n, compared without dividing
+    for (i = 0; i < T6_IMU_AXES; ++i) {
+        s64 nvar = gb->sumsq[i] * n - (s64)gb->sum[i] * gb->sum[i];
+        s64 max = i < 3 ? T6_BIAS_ACCEL_VAR_MAX : T6_BIAS_GYRO_VAR_MAX;
+        if (nvar > max * n * n)
+            return;
+    }
+    for (i = 3; i < T6_IMU_AXES; ++i) {
+        if (abs(gb->sum[i] >> T6_BIAS_WINDOW_SHIFT) > T6_BIAS_GYRO_MEAN_MAX)
+            return;
+    }
+
+    gain = min(gb->confidence + 1, T6_BIAS_GAIN_MIN);
+    for (i = 0; i < 3; ++i) {
+        s32 mean_q8 = (gb->sum[i + 3] * 256) >> T6_BIAS_WINDOW_SHIFT;
+        gb->bias_q8[i] += (mean_q8 - gb->bias_q8[i]) / (s32)gain;
+    }
+    if (gb->confidence < T6_BIAS_CONFIDENCE_MAX)
+        ++gb->confidence;
+}
+
+/*
+ * learns from the raw sample, then takes the bias off the gyro axes.
+ */
+static void btp_t6_gyro_bias_update(struct btp_t6_gyro_bias *gb, s32 *imu)
+{
+    int i;
+
+    for (i = 0; i < T6_IMU_AXES; ++i) {
+        gb->sum[i] += imu[i];
+        gb->sumsq[i] += imu[i] * imu[i];
+    }
+    if (++gb->count == 1 << T6_BIAS_WINDOW_SHIFT) {
+        btp_t6_gyro_bias_window(gb);
+        gb->count = 0;
+        memset(gb->sum, 0, sizeof(gb->sum));
+        memset(gb->sumsq, 0, sizeof(gb->sumsq));
+    }
+
+    if (!gb->enabled)
+        return;
+    for (i = 0; i < 3; ++i)
+        imu[i + 3] -= DIV_ROUND_CLOSEST(gb->bias_q8[i], 256);
+}
+
+// first order low pass gain in q16, g is 2 pi dt in q16 per 10^6 mHz
+static u32 btp_t6_smooth_alpha(unsigned int cutoff, u64 g)
+{
+    u64 x = div_u64((u64)cutoff * g, 1000000);
+
+    return div_u64(x << 16, (1 << 16) + x);
+}
+
+static void btp_t6_smooth_update(struct btp_t6_smooth *sm, s32 *v, int n,
+                ktime_t rx)
+{
+    u64 rx_ns = ktime_to_ns(rx), gap = rx_ns - sm->last_rx_ns;
+    u64 start, g, rate_q8;
+    u32 a_d, a, a_fast = 1 << 16;
+    s32 fastest = -1;
+    s64 d, lag;
+    int i;
+
+    if (!sm->min_cutoff)
+        return;
+    start = ktime_get_ns();
+    sm->last_rx_ns = rx_ns;
+
+    // the first sample after a reset or a stall only seeds the state
+    if (!sm->primed || gap > T6_SMOOTH_GAP_MAX_NS) {
+        for (i = 0; i < n; ++i) {
+            sm->x_q8[i] = v[i] * 256;
+            sm->dx[i] = 0;
+        }
+        sm->period_ns = 0;
+        sm->primed = true;
+        return;
+    }
+    if (!sm->period_ns)
+        sm->period_ns = gap;
+    else
+        sm->period_ns += ((s64)gap - (s64)sm->period_ns) >> T6_SMOOTH_PERIOD_SHIFT;
+    if (!sm->period_ns)
+        return;
+
+    g = div_u64(sm->period_ns * T6_SMOOTH_2PI_Q16, 1000000);
+    rate_q8 = div_u64(NSEC_PER_SEC << 8, sm->period_ns);
+    a_d = btp_t6_smooth_alpha(T6_SMOOTH_D_CUTOFF, g);
+
+    for (i = 0; i < n; ++i) {
+        d = v[i] * 256 - sm->x_q8[i];
+        sm->dx[i] += ((((d * (s64)rate_q8) >> 16) - sm->dx[i]) * a_d) >> 16;
+        a = btp_t6_smooth_alpha(min_t(u64, sm->min_cutoff +
+                div_u64((u64)sm->beta * abs(sm->dx[i]), 1000),
+                T6_SMOOTH_CUTOFF_MAX), g);
+        sm->x_q8[i] += (d * a) >> 16;
+        v[i] = DIV_ROUND_CLOSEST(sm->x_q8[i], 256);
+        if (abs(sm->dx[i]) > fastest) {
+            fastest = abs(sm->dx[i]);
+            a_fast = max(a, 1u);
+        }
+    }
+
+    // a low pass with gain a lags by (1 - a) / a samples
+    lag = div_u64(sm->period_ns * ((1 << 16) - a_fast), a_fast);
+    sm->lag_ns += (lag - (s64)sm->lag_ns) >> 4;
+    sm->cost_ns += ((s64)(ktime_get_ns() - start) - (s64)sm->cost_ns) >> 4;
+}
+
+static void btp_t6_fusion_reset(struct btp_t6_fusion *f)
+{
+    f->q[0] = 1 << 30;
+    f->q[1] = f->q[2] = f->q[3] = 0;
+    f->init_samples = T6_FUSION_INIT_SAMPLES;
+    f->last_t_ns = 0;
+}
+
+static void btp_t6_fusion_update(struct btp_t6_fusion *f,
+                const s32 *imu, u64 t_ns)
+{
+    s64 qw = f->q[0], qx = f->q[1], qy = f->q[2], qz = f->q[3];
+    s64 gx, gy, gz, dqw, dqx, dqy, dqz, h;
+    u64 norm, dt_ns;
+
+    dt_ns = f->last_t_ns ? t_ns - f->last_t_ns : 0;
+    f->last_t_ns = t_ns;
+    if (!dt_ns || dt_ns > T6_FUSION_DT_MAX_NS)
+        return;
+
+    gx = imu[3] * T6_FUSION_GYRO_Q24;
+    gy = imu[4] * T6_FUSION_GYRO_Q24;
+    gz = imu[5] * T6_FUSION_GYRO_Q24;
+
+    // only trust accel as gravity when it's somewhere near 1g
+    norm = int_sqrt64((s64)imu[0] * imu[0] + (s64)imu[1] * imu[1] +
+                (s64)imu[2] * imu[2]);
+    if (norm > T6_IMU_ACCEL_RES / 2 && norm < T6_IMU_ACCEL_RES * 3 / 2) {
+        s64 ax = div64_s64((s64)imu[0] << 30, norm);
+        s64 ay = div64_s64((s64)imu[1] << 30, norm);
+        s64 az = div64_s64((s64)imu[2] << 30, norm);
+        // gravity as the current estimate sees it
+        s64 vx = (qx * qz - qw * qy) >> 29;
+        s64 vy = (qw * qx + qy * qz) >> 29;
+        s64 vz = (qw * qw - qx * qx - qy * qy + qz * qz) >> 30;
+        s64 kp = div_u64((u64)f->gain << 16, 1000);
+
+        if (f->init_samples) {
+            kp *= T6_FUSION_INIT_BOOST;
+            --f->init_samples;
+        }
+        gx += (kp * (((ay * vz - az * vy) >> 30) >> 6)) >> 16;
+        gy += (kp * (((az * vx - ax * vz) >> 30) >> 6)) >> 16;
+        gz += (kp * (((ax * vy - ay * vx) >> 30) >> 6)) >> 16;
+    }
+
+    // q += q * (0, g) * dt / 2, h is dt / 2 in q30 seconds
+    h = div_u64(dt_ns << 29, NSEC_PER_SEC);
+    dqw = (-qx * gx - qy * gy - qz * gz) >> 30;
+    dqx = (qw * gx + qy * gz - qz * gy) >> 30;
+    dqy = (qw * gy - qx * gz + qz * gx) >> 30;
+    dqz = (qw * gz + qx * gy - qy * gx) >> 30;
+    qw += (dqw * h) >> 24;
+    qx += (dqx * h) >> 24;
+    qy += (dqy * h) >> 24;
+    qz += (dqz * h) >> 24;
+
+    norm = int_sqrt64(qw * qw + qx * qx + qy * qy + qz * qz);
+    if (!norm) {
+        btp_t6_fusion_reset(f);
+        return;
+    }
+    f->q[0] = div64_s64(qw << 30, norm);
+    f->q[1] = div64_s64(qx << 30, norm);
+    f->q[2] = div64_s64(qy << 30, norm);
+    f->q[3] = div64_s64(qz << 30, norm);
+}
+
+static void btp_t6_report_orientation(struct btp_t6_ctlr *ctlr,
+                const s32 *imu)
+{
+    struct input_dev *orient_input = ctlr->orient_input;
+    struct btp_t6_fusion *f = &ctlr->fusion;
+    u64 start = ktime_get_ns();
+    s64 cost;
+
+    btp_t6_fusion_update(f, imu, ctlr->clock.t_ns);
+
+    input_event(orient_input, EV_MSC, MSC_TIMESTAMP, ctlr->clock.timestamp_us);
+    input_report_abs(orient_input, ABS_X, f->q[1] >> 16);
+    input_report_abs(orient_input, ABS_Y, f->q[2] >> 16);
+    input_report_abs(orient_input, ABS_Z, f->q[3] >> 16);
+    input_report_abs(orient_input, ABS_MISC, f->q[0] >> 16);
+    input_sync(orient_input);
+
+    cost = ktime_get_ns() - start;
+    f->cost_ns += (cost - (s64)f->cost_ns) >> 4;
+}
+
+#if IS_REACHABLE(CONFIG_IIO_KFIFO_BUF)
+/*
+ * the recovered time is on CLOCK_MONOTONIC,
+ * moved to whatever clock the iio device is set to.
+ */
+static void btp_t6_iio_push(struct btp_t6_ctlr *ctlr, const s32 *imu)
+{
+    struct iio_dev *indio_dev = ctlr->indio_dev;
+    s64 ts;
+    int i;
+
+    for (i = 0; i < T6_IMU_AXES; ++i)
+        ctlr->iio_scan.imu[i] = clamp_val(imu[i], S16_MIN, S16_MAX);
+
+    if (!iio_buffer_enabled(indio_dev))
+        return;
+
+    ts = ctlr->clock.t_ns + (iio_get_time_ns(indio_dev) - ktime_get_ns());
+    iio_push_to_buffers_with_timestamp(indio_dev, &ctlr->iio_scan, ts);
+}
+#else
+static void btp_t6_iio_push(struct btp_t6_ctlr *ctlr, const s32 *imu)
+{
+}
+#endif
+
+// called with ctlr->lock held, the only writer
+static void btp_t6_ring_push(struct btp_t6_ring *ring, const s32 *imu,
+                const struct btp_t6_clock *clk)
+{
+    u64 n = ring->head + 1;
+    struct btp_t6_ring_sample *sample =
+        &ring->slots[(n - 1) & (BTP_T6_RING_SLOTS - 1)];
+    int i;
+
+    WRITE_ONCE(sample->seq, 0);
+    smp_wmb();
+    sample->time_ns = clk->t_ns;
+    sample->timestamp_us = clk->timestamp_us;
+    for (i = 0; i < T6_IMU_AXES; ++i)
+        sample->imu[i] = clamp_val(imu[i], S16_MIN, S16_MAX);
+    smp_wmb();
+    WRITE_ONCE(sample->seq, n);
+    smp_store_release(&ring->hdr->head, n);
+    ring->head = n;
+
+    if (wq_has_sleeper(&ring->wait))
+        wake_up_interruptible_poll(&ring->wait, EPOLLIN | EPOLLRDNORM);
+}
+
+/*
+ * these axises are nintendo layout.
+ * the gyro offset is tracked by btp_t6_gyro_bias_update,
+ * accel still got some shift.
+ */
+static bool btp_t6_parse_imu(struct btp_t6_ctlr *ctlr,
+                struct btp_t6_imu_data *imu_data)
+{
+    s32 imu[T6_IMU_AXES] = {
+        imu_data->accel_x, imu_data->accel_y, imu_data->accel_z,
+        imu_data->gyro_x, imu_data->gyro_y, imu_data->gyro_z,
+    };
+
+    unsigned int hid = ctlr->hdev->id;
+    bool ready;
+
+    btp_t6_clock_update(&ctlr->clock, ctlr->rx_time);
+    btp_t6_gyro_bias_update(&ctlr->gyro_bias, imu);
+    if (ctlr->ring)
+        btp_t6_ring_push(ctlr->ring, imu, &ctlr->clock);
+    if (ctlr->orient_input) {
+        btp_t6_report_orientation(ctlr, imu);
+        trace_btp_t6_parse(hid, T6_TRACE_STAGE_ORIENT, ctlr->rx_time);
+    }
+    if (ctlr->indio_dev) {
+        btp_t6_iio_push(ctlr, imu);
+        trace_btp_t6_parse(hid, T6_TRACE_STAGE_IIO, ctlr->rx_time);
+    }
+
+    // only the input device is smoothed, the others get the plain samples
+    btp_t6_smooth_update(&ctlr->imu_smooth, imu, T6_IMU_AXES, ctlr->rx_time);
+    ready = btp_t6_imu_decimate(ctlr, imu);
+    trace_btp_t6_parse(hid, T6_TRACE_STAGE_IMU, ctlr->rx_time);
+    return ready;
+}
+
+static void btp_t6_parse_controller(struct btp_t6_ctlr *ctlr,
+                struct btp_t6_controller_data *ctlr_data)
+{
+    struct input_dev *input = ctlr->input;
+    u32 btns = hid_field_extract(ctlr->hdev,
+                ctlr_data->button_status, 0, 24);
+    unsigned long changed = btns ^ ctlr->last_btns;
+    unsigned int bit;
+    s32 axes[T6_AXIS_COUNT] = {
+        ctlr->axis_lut[T6_AXIS_LX][ctlr_data->left_stick_x],
+        ctlr->axis_lut[T6_AXIS_LY][ctlr_data->left_stick_y],
+        ctlr->axis_lut[T6_AXIS_RX][ctlr_data->right_stick_x],
+        ctlr->axis_lut[T6_AXIS_RY][ctlr_data->right_stick_y],
+        ctlr->axis_lut[T6_AXIS_LT][ctlr_data->left_trigger],
+        ctlr->axis_lut[T6_AXIS_RT][ctlr_data->right_trigger],
+    };
+
+    // the button word hardly ever changes, only walk the bits that did
+    for_each_set_bit(bit, &changed, T6_BTN_COUNT) {
+        if (ctlr->keymap[bit] != KEY_RESERVED)
+            input_report_key(input, ctlr->keymap[bit], btns & BIT(bit));
+    }
+    ctlr->last_btns = btns;
+
+    btp_t6_smooth_update(&ctlr->stick_smooth, axes, T6_AXIS_COUNT, ctlr->rx_time);
+    input_report_abs(input, ABS_X, axes[T6_AXIS_LX]);
+    input_report_abs(input, ABS_Y, axes[T6_AXIS_LY]);
+    input_report_abs(input, ABS_RX, axes[T6_AXIS_RX]);
+    input_report_abs(input, ABS_RY, axes[T6_AXIS_RY]);
+    input_report_abs(input, ABS_Z, axes[T6_AXIS_LT]);
+    input_report_abs(input, ABS_RZ, axes[T6_AXIS_RT]);
+
+    trace_btp_t6_parse(ctlr->hdev->id, T6_TRACE_STAGE_CTLR, ctlr->rx_time);
+}
+
+static void btp_t6_parse_report(struct btp_t6_ctlr *ctlr,
+                const struct btp_t6_report_layout *layout, u8 *data)
+{
+    bool imu_ready = false;
+
+    if (layout->ctlr >= 0)
+        btp_t6_parse_controller(ctlr,
+            (struct btp_t6_controller_data *)(data + layout->ctlr));
+    if (layout->imu >= 0)
+        imu_ready = btp_t6_parse_imu(ctlr,
+            (struct btp_t6_imu_data *)(data + layout->imu));
+
+    if (layout->ctlr >= 0) {
+        input_sync(ctlr->input);
+        trace_btp_t6_sync(ctlr->hdev->id, T6_TRACE_INPUT_CTLR, ctlr->rx_time);
+    }
+    if (imu_ready) {
+        input_sync(ctlr->imu_input);
+        trace_btp_t6_sync(ctlr->hdev->id, T6_TRACE_INPUT_IMU, ctlr->rx_time);
+    }
+}
+
+static void btp_t6_stats_report(struct btp_t6_stats *stats,
+                u8 id, ktime_t rx)
+{
+    u64 rx_ns = ktime_to_ns(rx);
+    u64 delta = rx_ns - stats->last_rx_ns;
+    int bucket;
+
+    ++stats->reports;
+    if (id < T6_STATS_IDS)
+        ++stats->ids[id];
+
+    if (stats->last_rx_ns) {
+        bucket = delta ? fls64(delta) - 1 - T6_STATS_HIST_MIN_SHIFT : 0;
+        bucket = clamp(bucket, 0, T6_STATS_HIST_BUCKETS - 1);
+        ++stats->hist[bucket];
+    }
+    stats->last_rx_ns = rx_ns;
+}
+
+// only parsed reports, from arrival, so the wait for the lock counts too
+static void btp_t6_stats_parsed(struct btp_t6_stats *stats, ktime_t rx)
+{
+    u64 cost = ktime_to_ns(ktime_sub(ktime_get(), rx));
+
+    ++stats->parsed;
+    stats->parse_ns_sum += cost;
+    stats->parse_ns_max = max(stats->parse_ns_max, cost);
+}
+
+static int btp_t6_ctlr_read_handler(struct btp_t6_ctlr *ctlr,
+                u8 *data, int size)
+{
+    const struct btp_t6_report_layout *layout = NULL;
+    int ret = 0;
+
+    btp_t6_stats_report(&ctlr->stats, data[0], ctlr->rx_time);
+
+    if (data[0] < T6_REPORT_IDS)
+        layout = ctlr->product->reports[data[0]];
+
+    if (layout && size >= layout->size) {
+        btp_t6_parse_report(ctlr, layout, data);
+        btp_t6_stats_parsed(&ctlr->stats, ctlr->rx_time);
+    } else if (layout) {
+        ++ctlr->stats.short_reports;
+        trace_btp_t6_drop(ctlr->hdev->id, data[0], size, T6_TRACE_DROP_SHORT);
+    } else {
+        ++ctlr->stats.unknown;
+        trace_btp_t6_drop(ctlr->hdev->id, data[0], size, T6_TRACE_DROP_UNKNOWN);
+    }
+    return ret;
+}
+
+static int btp_t6_ctlr_handle_event(struct btp_t6_ctlr *ctlr,
+                u8 *data, int size)
+{
+    int ret;
+    unsigned long flags;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    ret = btp_t6_ctlr_read_handler(ctlr, data, size);
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return ret;
+}
+
+static ssize_t imu_period_ns_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+    s64 period;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    period = ctlr->clock.period_q8 >> 8;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+
+    return sysfs_emit(buf, "%lld\n", period);
+}
+static DEVICE_ATTR_RO(imu_period_ns);
+
+static ssize_t imu_jitter_ns_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+    u64 jitter;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    jitter = ctlr->clock.jitter_ns;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+
+    return sysfs_emit(buf, "%llu\n", jitter);
+}
+static DEVICE_ATTR_RO(imu_jitter_ns);
+
+/*
+ * space separated integers, returns how many were parsed.
+ */
+static int btp_t6_parse_ints(const char *buf, int *vals, int max)
+{
+    int n = 0, len;
+
+    while (n < max && sscanf(buf, "%d%n", &vals[n], &len) == 1) {
+        buf += len;
+        ++n;
+    }
+    return n;
+}
+
+/*
+ * one keycode per button bit, 0 leaves the bit unmapped.
+ */
+static ssize_t keymap_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    int i, len = 0;
+
+    if (!ctlr->input)
+        return -ENODEV;
+
+    for (i = 0; i < T6_BTN_COUNT; ++i)
+        len += sysfs_emit_at(buf, len, "%u%c", READ_ONCE(ctlr->keymap[i]),
+                    i == T6_BTN_COUNT - 1 ? '\n' : ' ');
+    return len;
+}
+
+static ssize_t keymap_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    struct input_keymap_entry ke = { .flags = INPUT_KEYMAP_BY_INDEX };
+    int codes[T6_BTN_COUNT];
+    u16 old[T6_BTN_COUNT];
+    int i, n, ret;
+
+    if (!ctlr->input)
+        return -ENODEV;
+
+    n = btp_t6_parse_ints(buf, codes, T6_BTN_COUNT);
+    if (!n)
+        return -EINVAL;
+    for (i = 0; i < n; ++i) {
+        if (codes[i] < 0 || codes[i] > KEY_MAX)
+            return -EINVAL;
+        old[i] = READ_ONCE(ctlr->keymap[i]);
+    }
+
+    for (i = 0; i < n; ++i) {
+        ke.index = i;
+        ke.keycode = codes[i];
+        ret = input_set_keycode(ctlr->input, &ke);
+        if (ret)
+            goto restore;
+    }
+    return count;
+
+restore:
+    // all or nothing, put back the entries already changed
+    while (i--) {
+        ke.index = i;
+        ke.keycode = old[i];
+        input_set_keycode(ctlr->input, &ke);
+    }
+    return ret;
+}
+static DEVICE_ATTR_RW(keymap);
+
+/*
+ * one line per axis, "name min center max inner outer".
+ * written as "axis min center max [inner outer]", axis is 0-5 in the
+ * order shown, center is ignored for triggers.
+ */
+static ssize_t axis_calibration_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    struct btp_t6_axis_cal cal[T6_AXIS_COUNT];
+    unsigned long flags;
+    int i, len = 0;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    memcpy(cal, ctlr->axis_cal, sizeof(cal));
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+
+    for (i = 0; i < T6_AXIS_COUNT; ++i)
+        len += sysfs_emit_at(buf, len, "%s %d %d %d %d %d\n",
+                    btp_t6_axis_names[i], cal[i].min, cal[i].center,
+                    cal[i].max, cal[i].inner, cal[i].outer);
+    return len;
+}
+
+static ssize_t axis_calibration_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    struct btp_t6_axis_cal cal;
+    unsigned long flags;
+    int vals[6], n;
+
+    n = btp_t6_parse_ints(buf, vals, 6);
+    if (n != 4 && n != 6)
+        return -EINVAL;
+    if (vals[0] < 0 || vals[0] >= T6_AXIS_COUNT)
+        return -EINVAL;
+
+    cal.min = vals[1];
+    cal.center = vals[2];
+    cal.max = vals[3];
+    cal.inner = n == 6 ? vals[4] : 0;
+    cal.outer = n == 6 ? vals[5] : T6_AXIS_DEADZONE_MAX;
+    if (vals[0] >= T6_AXIS_LT)
+        cal.center = cal.min;
+
+    if (cal.min < 0 || cal.max > 255 || cal.min >= cal.max)
+        return -EINVAL;
+    if (vals[0] < T6_AXIS_LT && (cal.center <= cal.min || cal.center >= cal.max))
+        return -EINVAL;
+    if (cal.inner < 0 || cal.outer > T6_AXIS_DEADZONE_MAX || cal.inner >= cal.outer)
+        return -EINVAL;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    ctlr->axis_cal[vals[0]] = cal;
+    btp_t6_axis_build(ctlr, vals[0]);
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+static DEVICE_ATTR_RW(axis_calibration);
+
+static ssize_t axis_curve_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return sysfs_emit(buf, "%s\n",
+                btp_t6_axis_curve_names[READ_ONCE(ctlr->axis_curve)]);
+}
+
+static ssize_t axis_curve_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+    int curve, i;
+
+    curve = sysfs_match_string(btp_t6_axis_curve_names, buf);
+    if (curve < 0)
+        return curve;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    ctlr->axis_curve = curve;
+    for (i = 0; i < T6_AXIS_COUNT; ++i)
+        btp_t6_axis_build(ctlr, i);
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+static DEVICE_ATTR_RW(axis_curve);
+
+static ssize_t imu_decimation_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(ctlr->imu_avg.decimation));
+}
+
+static ssize_t imu_decimation_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+    unsigned int n;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &n);
+    if (ret)
+        return ret;
+    if (n < 1 || n > T6_IMU_DECIMATION_MAX)
+        return -EINVAL;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    ctlr->imu_avg.decimation = n;
+    ctlr->imu_avg.count = 0;
+    ctlr->imu_avg.primed = false;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+static DEVICE_ATTR_RW(imu_decimation);
+
+static ssize_t imu_filter_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return sysfs_emit(buf, "%s\n",
+                btp_t6_imu_filter_names[READ_ONCE(ctlr->imu_avg.filter)]);
+}
+
+static ssize_t imu_filter_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+    int filter;
+
+    filter = sysfs_match_string(btp_t6_imu_filter_names, buf);
+    if (filter < 0)
+        return filter;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    ctlr->imu_avg.filter = filter;
+    ctlr->imu_avg.count = 0;
+    ctlr->imu_avg.primed = false;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+static DEVICE_ATTR_RW(imu_filter);
+
+/*
+ * "x y z confidence", bias in 1/256 digit.
+ * writing it back (confidence optional) restores a saved calibration.
+ */
+static ssize_t gyro_bias_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    struct btp_t6_gyro_bias *gb = &ctlr->gyro_bias;
+    unsigned long flags;
+    s32 bias[3];
+    unsigned int confidence;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    memcpy(bias, gb->bias_q8, sizeof(bias));
+    confidence = gb->confidence;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+
+    return sysfs_emit(buf, "%d %d %d %u\n",
+                bias[0], bias[1], bias[2], confidence);
+}
+
+static ssize_t gyro_bias_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    struct btp_t6_gyro_bias *gb = &ctlr->gyro_bias;
+    unsigned long flags;
+    int vals[4];
+    int i, n;
+
+    n = btp_t6_parse_ints(buf, vals, ARRAY_SIZE(vals));
+    if (n < 3)
+        return -EINVAL;
+    // no more than the tracker itself would learn
+    for (i = 0; i < 3; ++i) {
+        if (vals[i] < -(T6_BIAS_GYRO_MEAN_MAX << 8) ||
+            vals[i] > T6_BIAS_GYRO_MEAN_MAX << 8)
+            return -EINVAL;
+    }
+    if (n == 3)
+        vals[3] = T6_BIAS_CONFIDENCE_MAX;
+    if (vals[3] < 0 || vals[3] > T6_BIAS_CONFIDENCE_MAX)
+        return -EINVAL;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    memcpy(gb->bias_q8, vals, sizeof(gb->bias_q8));
+    gb->confidence = vals[3];
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+static DEVICE_ATTR_RW(gyro_bias);
+
+static ssize_t gyro_bias_enable_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(ctlr->gyro_bias.enabled));
+}
+
+static ssize_t gyro_bias_enable_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    bool enabled;
+    int ret;
+
+    ret = kstrtobool(buf, &enabled);
+    if (ret)
+        return ret;
+    WRITE_ONCE(ctlr->gyro_bias.enabled, enabled);
+    return count;
+}
+static DEVICE_ATTR_RW(gyro_bias_enable);
+
+static ssize_t fusion_gain_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    if (!ctlr->orient_input)
+        return -ENODEV;
+    return sysfs_emit(buf, "%u\n", READ_ONCE(ctlr->fusion.gain));
+}
 
-enum btp_t6_ctlr_state {
-    T6_CTLR_STATE_INIT,
-    T6_CTLR_STATE_READ,
-    T6_CTLR_STATE_REMOVED,
-};
+static ssize_t fusion_gain_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned int gain;
+    int ret;
 
-struct btp_t6_ctlr {
-    enum btp_t6_ctlr_state state;
-    struct hid_device *hdev;
-    struct input_dev *input;
-    struct input_dev *imu_input;
-    unsigned int timestamp_us;
-    unsigned int last_pkt_ms;
-};
+    if (!ctlr->orient_input)
+        return -ENODEV;
+    ret = kstrtouint(buf, 0, &gain);
+    if (ret)
+        return ret;
+    if (gain > T6_FUSION_GAIN_MAX)
+        return -EINVAL;
+    WRITE_ONCE(ctlr->fusion.gain, gain);
+    return count;
+}
+static DEVICE_ATTR_RW(fusion_gain);
+
+static ssize_t fusion_reset_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    unsigned long flags;
+
+    if (!ctlr->orient_input)
+        return -ENODEV;
+    spin_lock_irqsave(&ctlr->lock, flags);
+    btp_t6_fusion_reset(&ctlr->fusion);
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+static DEVICE_ATTR_WO(fusion_reset);
+
+static ssize_t fusion_cost_ns_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    if (!ctlr->orient_input)
+        return -ENODEV;
+    return sysfs_emit(buf, "%llu\n", READ_ONCE(ctlr->fusion.cost_ns));
+}
+static DEVICE_ATTR_RO(fusion_cost_ns);
 
 /*
- * these axises are nintendo layout.
- * got some shift, don't know how to calibrate.
+ * "min_cutoff beta" of the adaptive smoothing, see btp_t6_smooth.
  */
-static void btp_t6_parse_imu(struct btp_t6_ctlr *ctlr,
-                struct btp_t6_imu_data *imu_data)
+static ssize_t btp_t6_smooth_show(struct btp_t6_smooth *sm, char *buf)
 {
-    struct input_dev *imu_input = ctlr->imu_input;
-    unsigned int msecs = jiffies_to_msecs(jiffies);
-    ctlr->timestamp_us += (msecs - ctlr->last_pkt_ms) * 1000;
+    return sysfs_emit(buf, "%u %u\n",
+                READ_ONCE(sm->min_cutoff), READ_ONCE(sm->beta));
+}
+
+static int btp_t6_smooth_store(struct btp_t6_ctlr *ctlr,
+                struct btp_t6_smooth *sm, const char *buf)
+{
+    unsigned long flags;
+    int vals[2];
 
-    input_event(imu_input, EV_MSC, MSC_TIMESTAMP, ctlr->timestamp_us);
-    input_report_abs(imu_input, ABS_X, imu_data->accel_x);
-    input_report_abs(imu_input, ABS_Y, imu_data->accel_y);
-    input_report_abs(imu_input, ABS_Z, imu_data->accel_z);
-    input_report_abs(imu_input, ABS_RX, imu_data->gyro_x * 1000);
-    input_report_abs(imu_input, ABS_RY, imu_data->gyro_y * 1000);
-    input_report_abs(imu_input, ABS_RZ, imu_data->gyro_z * 1000);
+    if (btp_t6_parse_ints(buf, vals, ARRAY_SIZE(vals)) != 2)
+        return -EINVAL;
+    if (vals[0] < 0 || vals[0] > T6_SMOOTH_CUTOFF_MAX || vals[1] < 0)
+        return -EINVAL;
 
-    ctlr->last_pkt_ms = msecs;
+    spin_lock_irqsave(&ctlr->lock, flags);
+    sm->min_cutoff = vals[0];
+    sm->beta = vals[1];
+    sm->primed = false;
+    sm->cost_ns = 0;
+    sm->lag_ns = 0;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return 0;
 }
 
-static void btp_t6_parse_controller(struct btp_t6_ctlr *ctlr,
-                struct btp_t6_controller_data *ctlr_data)
+static ssize_t stick_smoothing_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
 {
-    long lx, ly, rx, ry;
-    struct input_dev *input = ctlr->input;
-    u32 btns = hid_field_extract(ctlr->hdev,
-                ctlr_data->button_status, 0, 24);
-    
-    input_report_key(input, BTN_DPAD_UP, btns & T6_BTN_UP);
-    input_report_key(input, BTN_DPAD_DOWN, btns & T6_BTN_DOWN);
-    input_report_key(input, BTN_DPAD_LEFT, btns & T6_BTN_LEFT);
-    input_report_key(input, BTN_DPAD_RIGHT, btns & T6_BTN_RIGHT);
-    input_report_key(input, BTN_START, btns & T6_BTN_START);
-    input_report_key(input, BTN_SELECT, btns & T6_BTN_SELECT);
-    input_report_key(input, BTN_THUMBL, btns & T6_BTN_LSTICK);
-    input_report_key(input, BTN_THUMBR, btns & T6_BTN_RSTICK);
-    input_report_key(input, BTN_TL, btns & T6_BTN_LB);
-    input_report_key(input, BTN_TR, btns & T6_BTN_RB);
-    input_report_key(input, BTN_A, btns & T6_BTN_A);
-    input_report_key(input, BTN_B, btns & T6_BTN_B);
-    input_report_key(input, BTN_X, btns & T6_BTN_X);
-    input_report_key(input, BTN_Y, btns & T6_BTN_Y);
-    input_report_key(input, BTN_BASE, btns & T6_BTN_M1);
-    input_report_key(input, BTN_BASE2, btns & T6_BTN_M2);
-    input_report_key(input, BTN_BASE3, btns & T6_BTN_M3);
-    input_report_key(input, BTN_BASE4, btns & T6_BTN_M4);
-    
-    lx = ctlr_data->left_stick_x - T6_STICK_CENTER;
-    lx = lx * T6_STICK_MAG / T6_STICK_MAX;
-    ly = T6_STICK_CENTER - ctlr_data->left_stick_y;
-    ly = ly * T6_STICK_MAG / T6_STICK_MAX;
-    
-    rx = ctlr_data->right_stick_x - T6_STICK_CENTER;
-    rx = rx * T6_STICK_MAG / T6_STICK_MAX;
-    ry = T6_STICK_CENTER - ctlr_data->right_stick_y;
-    ry = ry * T6_STICK_MAG / T6_STICK_MAX;
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    if (!ctlr->input)
+        return -ENODEV;
+    return btp_t6_smooth_show(&ctlr->stick_smooth, buf);
+}
 
-    input_report_abs(input, ABS_X, lx);
-    input_report_abs(input, ABS_Y, ly);
-    input_report_abs(input, ABS_RX, rx);
-    input_report_abs(input, ABS_RY, ry);
-    input_report_abs(input, ABS_Z, ctlr_data->left_trigger);
-    input_report_abs(input, ABS_RZ, ctlr_data->right_trigger);
+static ssize_t stick_smoothing_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    int ret;
+
+    if (!ctlr->input)
+        return -ENODEV;
+    ret = btp_t6_smooth_store(ctlr, &ctlr->stick_smooth, buf);
+    if (ret)
+        return ret;
+    return count;
 }
+static DEVICE_ATTR_RW(stick_smoothing);
 
-static void btp_t6_parse_input4(struct btp_t6_ctlr *ctlr,
-                struct btp_t6_input_report *report)
+static ssize_t imu_smoothing_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
 {
-    btp_t6_parse_imu(ctlr, 
-        (struct btp_t6_imu_data*)report->data4.raw_imu);
-    input_sync(ctlr->imu_input);
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return btp_t6_smooth_show(&ctlr->imu_smooth, buf);
 }
 
-static void btp_t6_parse_input5(struct btp_t6_ctlr *ctlr,
-                struct btp_t6_input_report *report)
+static ssize_t imu_smoothing_store(struct device *dev,
+                struct device_attribute *attr, const char *buf, size_t count)
 {
-    btp_t6_parse_controller(ctlr, 
-        (struct btp_t6_controller_data*)report->data5.raw_ctlr);
-    btp_t6_parse_imu(ctlr, 
-        (struct btp_t6_imu_data*)report->data5.raw_imu);
-    
-    input_sync(ctlr->input);
-    input_sync(ctlr->imu_input);
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+    int i, ret;
+
+    ret = btp_t6_smooth_store(ctlr, &ctlr->imu_smooth, buf);
+    if (ret)
+        return ret;
+
+    // the filter does the fuzz's job, both at once would only add lag
+    for (i = 0; i < 3; ++i) {
+        input_abs_set_fuzz(ctlr->imu_input, btp_t6_imu_accel[i],
+            ctlr->imu_smooth.min_cutoff ? 0 : T6_IMU_ACCEL_FUZZ);
+        input_abs_set_fuzz(ctlr->imu_input, btp_t6_imu_gyro[i],
+            ctlr->imu_smooth.min_cutoff ? 0 : T6_IMU_GYRO_FUZZ);
+    }
+    return count;
 }
+static DEVICE_ATTR_RW(imu_smoothing);
 
-static int btp_t6_ctlr_read_handler(struct btp_t6_ctlr *ctlr,
-                u8 *data, int size)
+/*
+ * "stick imu", running averages while smoothing is on.
+ */
+static ssize_t smoothing_cost_ns_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return sysfs_emit(buf, "%llu %llu\n", READ_ONCE(ctlr->stick_smooth.cost_ns),
+                READ_ONCE(ctlr->imu_smooth.cost_ns));
+}
+static DEVICE_ATTR_RO(smoothing_cost_ns);
+
+static ssize_t smoothing_lag_us_show(struct device *dev,
+                struct device_attribute *attr, char *buf)
+{
+    struct btp_t6_ctlr *ctlr = hid_get_drvdata(to_hid_device(dev));
+
+    return sysfs_emit(buf, "%llu %llu\n",
+                div_u64(READ_ONCE(ctlr->stick_smooth.lag_ns), NSEC_PER_USEC),
+                div_u64(READ_ONCE(ctlr->imu_smooth.lag_ns), NSEC_PER_USEC));
+}
+static DEVICE_ATTR_RO(smoothing_lag_us);
+
+static struct attribute *btp_t6_attrs[] = {
+    &dev_attr_imu_period_ns.attr,
+    &dev_attr_imu_jitter_ns.attr,
+    &dev_attr_keymap.attr,
+    &dev_attr_axis_calibration.attr,
+    &dev_attr_axis_curve.attr,
+    &dev_attr_imu_decimation.attr,
+    &dev_attr_imu_filter.attr,
+    &dev_attr_gyro_bias.attr,
+    &dev_attr_gyro_bias_enable.attr,
+    &dev_attr_stick_smoothing.attr,
+    &dev_attr_imu_smoothing.attr,
+    &dev_attr_smoothing_cost_ns.attr,
+    &dev_attr_smoothing_lag_us.attr,
+    &dev_attr_fusion_gain.attr,
+    &dev_attr_fusion_reset.attr,
+    &dev_attr_fusion_cost_ns.attr,
+    NULL
+};
+ATTRIBUTE_GROUPS(btp_t6);
+
+/*
+ * usb i/o only runs while someone listens: an open input device or
+ * an enabled iio buffer. hid core keeps its own count on top of this,
+ * so hidraw readers keep the device open by themselves.
+ */
+static int btp_t6_io_get(struct btp_t6_ctlr *ctlr)
 {
     int ret = 0;
-    if (data[0] == 4 && size >= 32) {
-        btp_t6_parse_input4(ctlr, 
-            (struct btp_t6_input_report*)data);
-    } else if (data[0] == 5 && size >= 64) {
-        btp_t6_parse_input5(ctlr, 
-            (struct btp_t6_input_report*)data);
+
+    mutex_lock(&ctlr->io_lock);
+    if (ctlr->io_removed) {
+        ret = -ENODEV;
+    } else if (!ctlr->io_users) {
+        ret = hid_hw_open(ctlr->hdev);
+        if (ret)
+            hid_err(ctlr->hdev, "cannot start hardware I/O; ret=%d\n", ret);
     }
+    if (!ret)
+        WRITE_ONCE(ctlr->io_users, ctlr->io_users + 1);
+    mutex_unlock(&ctlr->io_lock);
     return ret;
 }
 
-static int btp_t6_ctlr_handle_event(struct btp_t6_ctlr *ctlr,
-                u8 *data, int size)
+static void btp_t6_io_put(struct btp_t6_ctlr *ctlr)
 {
-    int ret;
-    ret = btp_t6_ctlr_read_handler(ctlr, data, size);
-    return ret;
+    mutex_lock(&ctlr->io_lock);
+    if (!ctlr->io_removed && !WARN_ON(!ctlr->io_users)) {
+        WRITE_ONCE(ctlr->io_users, ctlr->io_users - 1);
+        if (!ctlr->io_users)
+            hid_hw_close(ctlr->hdev);
+    }
+    mutex_unlock(&ctlr->io_lock);
+}
+
+// input devices outlive remove(), their close after that is a no-op
+static void btp_t6_io_remove(struct btp_t6_ctlr *ctlr)
+{
+    mutex_lock(&ctlr->io_lock);
+    if (ctlr->io_users)
+        hid_hw_close(ctlr->hdev);
+    ctlr->io_users = 0;
+    ctlr->io_removed = true;
+    mutex_unlock(&ctlr->io_lock);
+}
+
+static int btp_t6_input_open(struct input_dev *input)
+{
+    return btp_t6_io_get(input_get_drvdata(input));
+}
+
+static void btp_t6_input_close(struct input_dev *input)
+{
+    btp_t6_io_put(input_get_drvdata(input));
 }
 
 static struct input_dev *btp_t6_init_input(struct btp_t6_ctlr *ctlr,
-                char *name)
+                const char *name)
 {
     struct input_dev *input;
     struct hid_device *hdev;
@@ -300,12 +1755,14 @@ static struct input_dev *btp_t6_init_input(struct btp_t6_ctlr *ctlr,
     input->id.product = hdev->product;
     input->id.version = hdev->version;
     input->dev.parent = &hdev->dev;
+    input->open = btp_t6_input_open;
+    input->close = btp_t6_input_close;
     input_set_drvdata(input, ctlr);
     return input;
 }
 
 static int btp_t6_register_controller(struct btp_t6_ctlr *ctlr,
-                char *name)
+                const char *name)
 {
     int i;
     
@@ -313,8 +1770,13 @@ static int btp_t6_register_controller(struct btp_t6_ctlr *ctlr,
     if (!ctlr->input)
         return -ENOMEM;
     
-    for (i = 0; i < ARRAY_SIZE(btp_t6_buttons); ++i) {
-        input_set_capability(ctlr->input, EV_KEY, btp_t6_buttons[i]);
+    memcpy(ctlr->keymap, btp_t6_default_keymap, sizeof(ctlr->keymap));
+    ctlr->input->keycode = ctlr->keymap;
+    ctlr->input->keycodesize = sizeof(ctlr->keymap[0]);
+    ctlr->input->keycodemax = ARRAY_SIZE(ctlr->keymap);
+    for (i = 0; i < ARRAY_SIZE(ctlr->keymap); ++i) {
+        if (ctlr->keymap[i] != KEY_RESERVED)
+            input_set_capability(ctlr->input, EV_KEY, ctlr->keymap[i]);
     }
     for (i = 0; i < ARRAY_SIZE(btp_t6_sticks); ++i) {
         input_set_abs_params(ctlr->input, btp_t6_sticks[i], 
@@ -328,7 +1790,7 @@ static int btp_t6_register_controller(struct btp_t6_ctlr *ctlr,
 }
 
 static int btp_t6_register_imu(struct btp_t6_ctlr *ctlr,
-                char *name)
+                const char *name)
 {
     int i;
 
@@ -356,42 +1818,470 @@ static int btp_t6_register_imu(struct btp_t6_ctlr *ctlr,
     return input_register_device(ctlr->imu_input);
 }
 
-static int btp_t6_input_create(struct btp_t6_ctlr *ctlr)
+/*
+ * not an accelerometer, but the property keeps it from being
+ * taken for a joystick, same as the imu device.
+ */
+static int btp_t6_register_orientation(struct btp_t6_ctlr *ctlr,
+                const char *name)
+{
+    int i;
+
+    ctlr->orient_input = btp_t6_init_input(ctlr, name);
+    if (!ctlr->orient_input)
+        return -ENOMEM;
+
+    for (i = 0; i < ARRAY_SIZE(btp_t6_orientation); ++i) {
+        input_set_abs_params(ctlr->orient_input, btp_t6_orientation[i],
+            -T6_ORIENT_MAX, T6_ORIENT_MAX, 0, 0);
+        input_abs_set_res(ctlr->orient_input, btp_t6_orientation[i],
+            T6_ORIENT_MAX);
+    }
+    input_set_capability(ctlr->orient_input, EV_MSC, MSC_TIMESTAMP);
+    __set_bit(INPUT_PROP_ACCELEROMETER, ctlr->orient_input->propbit);
+
+    ctlr->fusion.gain = T6_FUSION_GAIN;
+    btp_t6_fusion_reset(&ctlr->fusion);
+
+    return input_register_device(ctlr->orient_input);
+}
+
+#if IS_REACHABLE(CONFIG_IIO_KFIFO_BUF)
+static int btp_t6_iio_read_raw(struct iio_dev *indio_dev,
+                struct iio_chan_spec const *chan,
+                int *val, int *val2, long mask)
+{
+    struct btp_t6_ctlr *ctlr = *(struct btp_t6_ctlr **)iio_priv(indio_dev);
+    unsigned long flags;
+    s64 period;
+
+    switch (mask) {
+    case IIO_CHAN_INFO_RAW:
+        // nothing refreshes the values while usb i/o is stopped
+        if (!READ_ONCE(ctlr->io_users))
+            return -EBUSY;
+        spin_lock_irqsave(&ctlr->lock, flags);
+        *val = ctlr->iio_scan.imu[chan->scan_index];
+        spin_unlock_irqrestore(&ctlr->lock, flags);
+        return IIO_VAL_INT;
+    case IIO_CHAN_INFO_SCALE:
+        *val = 0;
+        if (chan->type == IIO_ACCEL)
+            *val2 = div_u64(T6_IIO_G_NANO, T6_IMU_ACCEL_RES);
+        else
+            *val2 = div_u64(T6_IIO_DEG_NANORAD * 1000, T6_IMU_GYRO_RES);
+        return IIO_VAL_INT_PLUS_NANO;
+    case IIO_CHAN_INFO_SAMP_FREQ:
+        spin_lock_irqsave(&ctlr->lock, flags);
+        period = ctlr->clock.period_q8 >> 8;
+        spin_unlock_irqrestore(&ctlr->lock, flags);
+        if (period <= 0)
+            return -ENODATA;
+        *val = div_s64_rem(NSEC_PER_SEC, (s32)period, val2);
+        *val2 = div_s64((s64)*val2 * USEC_PER_SEC, period);
+        return IIO_VAL_INT_PLUS_MICRO;
+    }
+    return -EINVAL;
+}
+
+static const struct iio_info btp_t6_iio_info = {
+    .read_raw = btp_t6_iio_read_raw,
+};
+
+static int btp_t6_iio_preenable(struct iio_dev *indio_dev)
+{
+    return btp_t6_io_get(*(struct btp_t6_ctlr **)iio_priv(indio_dev));
+}
+
+static int btp_t6_iio_postdisable(struct iio_dev *indio_dev)
+{
+    btp_t6_io_put(*(struct btp_t6_ctlr **)iio_priv(indio_dev));
+    return 0;
+}
+
+static const struct iio_buffer_setup_ops btp_t6_iio_buffer_ops = {
+    .preenable = btp_t6_iio_preenable,
+    .postdisable = btp_t6_iio_postdisable,
+};
+
+static int btp_t6_register_iio(struct btp_t6_ctlr *ctlr)
+{
+    struct hid_device *hdev = ctlr->hdev;
+    struct iio_dev *indio_dev;
+    int ret;
+
+    indio_dev = devm_iio_device_alloc(&hdev->dev, sizeof(ctlr));
+    if (!indio_dev)
+        return -ENOMEM;
+    *(struct btp_t6_ctlr **)iio_priv(indio_dev) = ctlr;
+
+    indio_dev->name = "betop-t6-imu";
+    indio_dev->info = &btp_t6_iio_info;
+    indio_dev->modes = INDIO_DIRECT_MODE;
+    indio_dev->channels = btp_t6_iio_channels;
+    indio_dev->num_channels = ARRAY_SIZE(btp_t6_iio_channels);
+    indio_dev->available_scan_masks = btp_t6_iio_scan_masks;
+
+    ret = devm_iio_kfifo_buffer_setup(&hdev->dev, indio_dev,
+                &btp_t6_iio_buffer_ops);
+    if (ret)
+        return ret;
+
+    ret = devm_iio_device_register(&hdev->dev, indio_dev);
+    if (ret)
+        return ret;
+
+    ctlr->indio_dev = indio_dev;
+    return 0;
+}
+#else
+static int btp_t6_register_iio(struct btp_t6_ctlr *ctlr)
 {
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_DEBUG_FS
+static int btp_t6_stats_show(struct seq_file *m, void *unused)
+{
+    struct btp_t6_ctlr *ctlr = m->private;
+    struct btp_t6_stats stats;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    stats = ctlr->stats;
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+
+    seq_printf(m, "reports: %llu\n", stats.reports);
+    for (i = 0; i < T6_STATS_IDS; ++i) {
+        if (stats.ids[i])
+            seq_printf(m, "id %d: %llu\n", i, stats.ids[i]);
+    }
+    seq_printf(m, "unknown: %llu\n", stats.unknown);
+    seq_printf(m, "short: %llu\n", stats.short_reports);
+    seq_printf(m, "not_ready: %llu\n", stats.not_ready);
+    seq_printf(m, "idle: %llu\n", stats.idle);
+    seq_printf(m, "parse avg (ns): %llu\n", stats.parsed ?
+        div64_u64(stats.parse_ns_sum, stats.parsed) : 0);
+    seq_printf(m, "parse max (ns): %llu\n", stats.parse_ns_max);
+
+    seq_puts(m, "inter-arrival (us):\n");
+    for (i = 0; i < T6_STATS_HIST_BUCKETS; ++i) {
+        u64 lo = i ? 1ULL << (i + T6_STATS_HIST_MIN_SHIFT) : 0;
+        u64 hi = 1ULL << (i + 1 + T6_STATS_HIST_MIN_SHIFT);
+
+        if (i == T6_STATS_HIST_BUCKETS - 1)
+            seq_printf(m, "  %7llu - inf     : %llu\n",
+                div_u64(lo, NSEC_PER_USEC), stats.hist[i]);
+        else
+            seq_printf(m, "  %7llu - %-7llu : %llu\n",
+                div_u64(lo, NSEC_PER_USEC), div_u64(hi, NSEC_PER_USEC),
+                stats.hist[i]);
+    }
+    return 0;
+}
+
+static int btp_t6_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, btp_t6_stats_show, inode->i_private);
+}
+
+// any write clears the counters
+static ssize_t btp_t6_stats_write(struct file *file, const char __user *buf,
+                size_t count, loff_t *ppos)
+{
+    struct btp_t6_ctlr *ctlr = ((struct seq_file *)file->private_data)->private;
+    unsigned long flags;
+
+    spin_lock_irqsave(&ctlr->lock, flags);
+    memset(&ctlr->stats, 0, sizeof(ctlr->stats));
+    spin_unlock_irqrestore(&ctlr->lock, flags);
+    return count;
+}
+
+static const struct file_operations btp_t6_stats_fops = {
+    .owner      = THIS_MODULE,
+    .open       = btp_t6_stats_open,
+    .read       = seq_read,
+    .write      = btp_t6_stats_write,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+/*
+ * lives in the hid core's debugfs directory of the device,
+ * /sys/kernel/debug/hid/<dev>/btp_t6_stats
+ */
+static void btp_t6_debugfs_init(struct btp_t6_ctlr *ctlr)
+{
+    if (ctlr->hdev->debug_dir)
+        ctlr->debugfs = debugfs_create_file("btp_t6_stats", 0600,
+            ctlr->hdev->debug_dir, ctlr, &btp_t6_stats_fops);
+}
+#else
+static void btp_t6_debugfs_init(struct btp_t6_ctlr *ctlr) {}
+#endif
+
+static void btp_t6_ring_free(struct kref *ref)
+{
+    struct btp_t6_ring *ring = container_of(ref, struct btp_t6_ring, ref);
+
+    vfree(ring->hdr);
+    kfree(ring);
+}
+
+static bool btp_t6_ring_ready(struct btp_t6_ring_reader *reader)
+{
+    return smp_load_acquire(&reader->ring->hdr->head) - reader->seen
+        >= reader->watermark;
+}
+
+// an open file counts as a listener, like an open input device
+static int btp_t6_ring_open(struct inode *inode, struct file *file)
+{
+    struct btp_t6_ring *ring = container_of(file->private_data,
+                struct btp_t6_ring, misc);
+    struct btp_t6_ring_reader *reader;
+    int ret;
+
+    reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    if (!reader)
+        return -ENOMEM;
+
+    mutex_lock(&ring->lock);
+    ret = ring->ctlr ? btp_t6_io_get(ring->ctlr) : -ENODEV;
+    mutex_unlock(&ring->lock);
+    if (ret) {
+        kfree(reader);
+        return ret;
+    }
+
+    kref_get(&ring->ref);
+    reader->ring = ring;
+    reader->seen = smp_load_acquire(&ring->hdr->head);
+    reader->watermark = 1;
+    file->private_data = reader;
+    return stream_open(inode, file);
+}
+
+static int btp_t6_ring_release(struct inode *inode, struct file *file)
+{
+    struct btp_t6_ring_reader *reader = file->private_data;
+    struct btp_t6_ring *ring = reader->ring;
+
+    mutex_lock(&ring->lock);
+    if (ring->ctlr)
+        btp_t6_io_put(ring->ctlr);
+    mutex_unlock(&ring->lock);
+
+    kref_put(&ring->ref, btp_t6_ring_free);
+    kfree(reader);
+    return 0;
+}
+
+// returns head once watermark new samples are in
+static ssize_t btp_t6_ring_read(struct file *file, char __user *buf,
+                size_t count, loff_t *ppos)
+{
+    struct btp_t6_ring_reader *reader = file->private_data;
+    struct btp_t6_ring *ring = reader->ring;
+    u64 head;
+    int ret;
+
+    if (count < sizeof(head))
+        return -EINVAL;
+
+    if (!btp_t6_ring_ready(reader)) {
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(ring->wait,
+            btp_t6_ring_ready(reader) || READ_ONCE(ring->removed));
+        if (ret)
+            return ret;
+        if (!btp_t6_ring_ready(reader))
+            return -ENODEV;
+    }
+
+    head = smp_load_acquire(&ring->hdr->head);
+    reader->seen = head;
+    if (copy_to_user(buf, &head, sizeof(head)))
+        return -EFAULT;
+    return sizeof(head);
+}
+
+static __poll_t btp_t6_ring_poll(struct file *file, poll_table *wait)
+{
+    struct btp_t6_ring_reader *reader = file->private_data;
+    struct btp_t6_ring *ring = reader->ring;
+    __poll_t mask = 0;
+
+    poll_wait(file, &ring->wait, wait);
+    if (btp_t6_ring_ready(reader))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (READ_ONCE(ring->removed))
+        mask |= EPOLLHUP | EPOLLERR;
+    return mask;
+}
+
+static long btp_t6_ring_ioctl(struct file *file, unsigned int cmd,
+                unsigned long arg)
+{
+    struct btp_t6_ring_reader *reader = file->private_data;
+    u32 watermark;
+
+    if (cmd != BTP_T6_RING_SET_WATERMARK)
+        return -ENOTTY;
+    if (get_user(watermark, (u32 __user *)arg))
+        return -EFAULT;
+    if (!watermark || watermark > BTP_T6_RING_SLOTS)
+        return -EINVAL;
+    WRITE_ONCE(reader->watermark, watermark);
+    return 0;
+}
+
+static void btp_t6_ring_vm_open(struct vm_area_struct *vma)
+{
+    struct btp_t6_ring *ring = vma->vm_private_data;
+
+    kref_get(&ring->ref);
+}
+
+static void btp_t6_ring_vm_close(struct vm_area_struct *vma)
+{
+    struct btp_t6_ring *ring = vma->vm_private_data;
+
+    kref_put(&ring->ref, btp_t6_ring_free);
+}
+
+static const struct vm_operations_struct btp_t6_ring_vm_ops = {
+    .open       = btp_t6_ring_vm_open,
+    .close      = btp_t6_ring_vm_close,
+};
+
+static int btp_t6_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct btp_t6_ring_reader *reader = file->private_data;
+    struct btp_t6_ring *ring = reader->ring;
+    int ret;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+
+    ret = remap_vmalloc_range(vma, ring->hdr, vma->vm_pgoff);
+    if (ret)
+        return ret;
+
+    vma->vm_private_data = ring;
+    vma->vm_ops = &btp_t6_ring_vm_ops;
+    btp_t6_ring_vm_open(vma);
+    return 0;
+}
+
+static const struct file_operations btp_t6_ring_fops = {
+    .owner          = THIS_MODULE,
+    .open           = btp_t6_ring_open,
+    .release        = btp_t6_ring_release,
+    .read           = btp_t6_ring_read,
+    .poll           = btp_t6_ring_poll,
+    .unlocked_ioctl = btp_t6_ring_ioctl,
+    .mmap           = btp_t6_ring_mmap,
+};
+
+static int btp_t6_ring_create(struct btp_t6_ctlr *ctlr)
+{
+    struct btp_t6_ring *ring;
+    size_t size = T6_RING_DATA_OFFSET +
+        BTP_T6_RING_SLOTS * sizeof(struct btp_t6_ring_sample);
     int ret;
+
+    BUILD_BUG_ON(sizeof(struct btp_t6_ring_header) > T6_RING_DATA_OFFSET);
+    BUILD_BUG_ON(!is_power_of_2(BTP_T6_RING_SLOTS));
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring)
+        return -ENOMEM;
+
+    ring->hdr = vmalloc_user(PAGE_ALIGN(size));
+    if (!ring->hdr) {
+        kfree(ring);
+        return -ENOMEM;
+    }
+    ring->hdr->version = BTP_T6_RING_VERSION;
+    ring->hdr->slots = BTP_T6_RING_SLOTS;
+    ring->hdr->sample_size = sizeof(struct btp_t6_ring_sample);
+    ring->hdr->data_offset = T6_RING_DATA_OFFSET;
+    ring->slots = (void *)ring->hdr + T6_RING_DATA_OFFSET;
+
+    kref_init(&ring->ref);
+    mutex_init(&ring->lock);
+    init_waitqueue_head(&ring->wait);
+    ring->ctlr = ctlr;
+
+    snprintf(ring->name, sizeof(ring->name), "betop-t6-imu%u", ctlr->hdev->id);
+    ring->misc.minor = MISC_DYNAMIC_MINOR;
+    ring->misc.name = ring->name;
+    ring->misc.fops = &btp_t6_ring_fops;
+    ring->misc.parent = &ctlr->hdev->dev;
+
+    ret = misc_register(&ring->misc);
+    if (ret) {
+        kref_put(&ring->ref, btp_t6_ring_free);
+        return ret;
+    }
+    ctlr->ring = ring;
+    return 0;
+}
+
+// after hid_hw_stop, nothing pushes anymore
+static void btp_t6_ring_remove(struct btp_t6_ctlr *ctlr)
+{
+    struct btp_t6_ring *ring = ctlr->ring;
+
+    if (!ring)
+        return;
+
+    misc_deregister(&ring->misc);
+    mutex_lock(&ring->lock);
+    ring->ctlr = NULL;
+    WRITE_ONCE(ring->removed, true);
+    mutex_unlock(&ring->lock);
+    wake_up_interruptible_all(&ring->wait);
+
+    ctlr->ring = NULL;
+    kref_put(&ring->ref, btp_t6_ring_free);
+}
+
+static int btp_t6_input_create(struct btp_t6_ctlr *ctlr)
+{
+    int i, ret;
     struct hid_device *hdev;
-    char *name, *imu_name;
+    const struct btp_t6_product *product = ctlr->product;
 
     hdev = ctlr->hdev;
 
-    switch(hdev->product) {
-    case USB_DEVICE_ID_BETOP_T6_USB:
-        name = "Betop T6 For USB";
-        imu_name = "Betop T6 For USB IMU";
-        break;
-    case USB_DEVICE_ID_BETOP_T6_ADAPTER:
-        name = "Betop T6 For Adapter";
-        imu_name = "Betop T6 For Adapter IMU";
-        break;
-    case USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO:
-        name = "Betop T6 For USB With Audio";
-        imu_name = "Betop T6 For USB With Audio IMU";
-        break;
-    case USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO:
-        name = "Betop T6 For Adapter With Audio";
-        imu_name = "Betop T6 For Adapter With Audio IMU";
-        break;
+    // any report with a controller block means there are buttons
+    for (i = 0; i < T6_REPORT_IDS; ++i) {
+        if (product->reports[i] && product->reports[i]->ctlr >= 0) {
+            ret = btp_t6_register_controller(ctlr, product->name);
+            if (ret) return ret;
+            break;
+        }
     }
-    
-    // only get report id 5 when wired, sad
-    if (hdev->product == USB_DEVICE_ID_BETOP_T6_USB ||
-        hdev->product == USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO) {
-        ret = btp_t6_register_controller(ctlr, name);
+
+    ret = btp_t6_register_imu(ctlr, product->imu_name);
+    if (ret) return ret;
+
+    if (orientation) {
+        ret = btp_t6_register_orientation(ctlr, product->orient_name);
         if (ret) return ret;
     }
 
-    ret = btp_t6_register_imu(ctlr, imu_name);
-    if (ret) return ret;
+    // evdev still works without it, not worth failing the probe
+    ret = btp_t6_register_iio(ctlr);
+    if (ret)
+        hid_warn(hdev, "Failed to register iio device; ret=%d\n", ret);
 
     return 0;
 }
@@ -421,6 +2311,9 @@ static int btp_t6_hid_probe(struct hid_device *hdev,
 
     hid_dbg(hdev, "probe - start\n");
     
+    if (!id->driver_data)
+        return -ENODEV;
+
     ctlr = devm_kzalloc(&hdev->dev, sizeof(*ctlr), GFP_KERNEL);
     if (!ctlr) {
         ret = -ENOMEM;
@@ -428,7 +2321,13 @@ static int btp_t6_hid_probe(struct hid_device *hdev,
     }
     
     ctlr->hdev = hdev;
+    ctlr->product = (const struct btp_t6_product *)id->driver_data;
     ctlr->state = T6_CTLR_STATE_INIT;
+    spin_lock_init(&ctlr->lock);
+    mutex_init(&ctlr->io_lock);
+    ctlr->imu_avg.decimation = 1;
+    ctlr->gyro_bias.enabled = true;
+    btp_t6_axis_init(ctlr);
     hid_set_drvdata(hdev, ctlr);
 
     ret = hid_parse(hdev);
@@ -442,11 +2341,6 @@ static int btp_t6_hid_probe(struct hid_device *hdev,
         hid_err(hdev, "HW start failed\n");
         goto err;
     }
-    ret = hid_hw_open(hdev);
-    if (ret) {
-        hid_err(hdev, "cannot start hardware I/O\n");
-        goto err_stop;
-    }
     hid_device_io_start(hdev);
 
 	ret = btp_t6_input_create(ctlr);
@@ -455,14 +2349,20 @@ static int btp_t6_hid_probe(struct hid_device *hdev,
 		goto err_close;
 	}
     
+    if (imu_ring) {
+        ret = btp_t6_ring_create(ctlr);
+        if (ret)
+            hid_warn(hdev, "Failed to register imu ring; ret=%d\n", ret);
+    }
+
+    btp_t6_debugfs_init(ctlr);
     ctlr->state = T6_CTLR_STATE_READ;
     
     hid_dbg(hdev, "probe - success\n");
     return 0;
 
 err_close:
-    hid_hw_close(hdev);
-err_stop:
+    btp_t6_io_remove(ctlr);
     hid_hw_stop(hdev);
 err:
     hid_err(hdev, "probe - fail = %d\n", ret);
@@ -474,12 +2374,29 @@ static int btp_t6_hid_event(struct hid_device *hdev,
 {
     int ret = 0;
     struct btp_t6_ctlr *ctlr = hid_get_drvdata(hdev);
+    ktime_t now = ktime_get();
+    unsigned long flags;
     
 	if (!ctlr || size < 1)
 		return -EINVAL;
 
-    if (ctlr->state == T6_CTLR_STATE_READ)
+    ctlr->rx_time = now;
+    trace_btp_t6_report(hdev->id, raw_data[0], size, now);
+
+    if (ctlr->state == T6_CTLR_STATE_READ && !READ_ONCE(ctlr->io_users)) {
+        // only hidraw is listening. the lock keeps the debugfs reset off it
+        spin_lock_irqsave(&ctlr->lock, flags);
+        ++ctlr->stats.idle;
+        spin_unlock_irqrestore(&ctlr->lock, flags);
+        trace_btp_t6_drop(hdev->id, raw_data[0], size, T6_TRACE_DROP_IDLE);
+    } else if (ctlr->state == T6_CTLR_STATE_READ)
 	    ret = btp_t6_ctlr_handle_event(ctlr, raw_data, size);
+    else {
+        spin_lock_irqsave(&ctlr->lock, flags);
+        ++ctlr->stats.not_ready;
+        spin_unlock_irqrestore(&ctlr->lock, flags);
+        trace_btp_t6_drop(hdev->id, raw_data[0], size, T6_TRACE_DROP_NOT_READY);
+    }
     return ret;
 }
 
@@ -490,20 +2407,26 @@ static void btp_t6_hid_remove(struct hid_device *hdev)
     hid_dbg(hdev, "remove\n");
 
     ctlr->state = T6_CTLR_STATE_REMOVED;
+    debugfs_remove(ctlr->debugfs);
 
-    hid_hw_close(hdev);
+    btp_t6_io_remove(ctlr);
     hid_hw_stop(hdev);
+    btp_t6_ring_remove(ctlr);
 }
 
 static const struct hid_device_id btp_t6_hid_devices[] = {
     { HID_USB_DEVICE(USB_VENDOR_ID_BETOP,
-            USB_DEVICE_ID_BETOP_T6_USB) },
+            USB_DEVICE_ID_BETOP_T6_USB),
+        .driver_data = (kernel_ulong_t)&btp_t6_product_usb },
     { HID_USB_DEVICE(USB_VENDOR_ID_BETOP, 
-            USB_DEVICE_ID_BETOP_T6_ADAPTER) },
+            USB_DEVICE_ID_BETOP_T6_ADAPTER),
+        .driver_data = (kernel_ulong_t)&btp_t6_product_adapter },
     { HID_USB_DEVICE(USB_VENDOR_ID_BETOP,
-            USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO) },
+            USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO),
+        .driver_data = (kernel_ulong_t)&btp_t6_product_usb_audio },
     { HID_USB_DEVICE(USB_VENDOR_ID_BETOP,
-            USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO) },
+            USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO),
+        .driver_data = (kernel_ulong_t)&btp_t6_product_adapter_audio },
     { }
 };
 MODULE_DEVICE_TABLE(hid, btp_t6_hid_devices);
@@ -515,10 +2438,17 @@ static struct hid_driver btp_t6_hid_driver = {
     .probe          = btp_t6_hid_probe,
     .remove         = btp_t6_hid_remove,
     .raw_event      = btp_t6_hid_event,
+    .driver = {
+        .dev_groups = btp_t6_groups,
+    },
 };
 
 module_hid_driver(btp_t6_hid_driver);
 
+#ifdef BTP_T6_KUNIT_TEST
+#include "hid-betop-t6-test.c"
+#endif
+
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Hou Lei <ameansone@outlook.com>");
 MODULE_DESCRIPTION("Driver for Betop T6 Controller");
\ No newline at end of file
@@ -1,15 +1,29 @@
 #include <linux/hidraw.h>
 #include <getopt.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#include "hid-ids.h"
 
 #define BYTE_TO_BINARY_PATTERN "%c%c%c%c%c%c%c%c"
 #define BYTE_TO_BINARY(byte)  \
@@ -30,148 +44,1671 @@ struct report_buf {
     int size;
 };
 
-char optstring[] = "p:d:n:f:";
+#define MAX_HIDRAW 64
+#define MAX_DEVICES 16
+// reports the hidraw driver queues per open file before dropping
+#define HIDRAW_QUEUE 64
+#define RING_SIZE 4096
+
+/*
+ * one opened hidraw node. reports land in pending as they are read,
+ * the display moves them into buf4/buf5 once per interval so the
+ * highlighting compares against what was shown last.
+ */
+struct mon_device {
+    int fd;
+    char path[32];
+    char name[256];
+    struct hidraw_devinfo info;
+    struct report_buf buf4, buf5;
+    char pending4[256], pending5[256];
+    int pending4_size, pending5_size;
+    uint64_t reports, reports4, reports5;
+    uint64_t shown, shown4, shown5;
+    struct plan* plan;
+    int gone;
+
+    // written by the reader thread
+    atomic_uint_fast64_t ring_drops;
+    atomic_uint_fast64_t maybe_overflow;
+};
+
+/*
+ * the reader thread only reads and timestamps, everything else
+ * (recording, decoding, display) runs on the main thread behind
+ * a single producer single consumer ring. a report with size 0
+ * tells the consumer the device is gone.
+ */
+struct ring_slot {
+    uint64_t ns;
+    uint16_t dev;
+    uint16_t size;
+    unsigned char data[256];
+};
+
+struct ring {
+    struct ring_slot slots[RING_SIZE];
+    atomic_uint_fast64_t head;
+    atomic_uint_fast64_t tail;
+    int efd;
+};
+
+struct reader {
+    struct ring* ring;
+    struct mon_device* devs;
+    int ndev;
+    int epfd;
+    atomic_int done;
+};
+
+/*
+ * capture file, append only:
+ *   header, then records, each starting with a type byte.
+ *   DEVICE  dev, vendor, product, name, report descriptor
+ *   FULL    dev, varint dt_ns, size, bytes
+ *   DELTA   dev, report id, varint dt_ns, size,
+ *           bitmap of changed bytes after the id, changed bytes
+ *   INDEX   u64 mono_ns, u64 reports so far, u64 offset of previous INDEX
+ *   END     u64 offset of last INDEX, only there if closed cleanly
+ * dt_ns is relative to the previous report of any device or INDEX.
+ * DELTA is against the previous report with the same dev and id,
+ * the first report after an INDEX is always FULL, so decoding can
+ * start at any INDEX.
+ */
+#define CAP_MAGIC "T6RAWCAP"
+#define CAP_VERSION 1
+#define CAP_INDEX_NS 1000000000ull
+#define CAP_MAX_DEVICES 16
+
+enum cap_record_type {
+    CAP_DEVICE = 1,
+    CAP_FULL,
+    CAP_DELTA,
+    CAP_INDEX,
+    CAP_END,
+};
+
+struct cap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t start_realtime_ns;
+    uint64_t start_mono_ns;
+};
+
+struct cap_stream {
+    int size;
+    unsigned char data[256];
+};
+
+struct cap_writer {
+    FILE* file;
+    uint64_t offset;
+    uint64_t last_ns;
+    uint64_t last_index_ns;
+    uint64_t last_index_offset;
+    uint64_t reports;
+    struct cap_stream* streams[CAP_MAX_DEVICES][256];
+};
+
+char optstring[] = "p:d:n:f:r:y:s:Dca";
 struct option options[] = {
     {"mode", required_argument, 0, 'm'},
     {"hidraw", required_argument, 0, 'p'},
     {"diff", required_argument, 0, 'd'},
     {"interval", required_argument, 0, 'n'},
     {"format", required_argument, 0, 'f'},
+    {"record", required_argument, 0, 'r'},
+    {"play", required_argument, 0, 'y'},
+    {"seek", required_argument, 0, 's'},
+    {"dump", no_argument, 0, 'D'},
+    {"csv", no_argument, 0, 'c'},
+    {"analyze", no_argument, 0, 'a'},
     {0, 0, 0, 0}
 };
 
-int is_exit = 0;
+atomic_int is_exit = 0;
 
-int sprint_report_bin(char* output_buf, struct report_buf* buf, int diff) {
-    int cursor = 0;
-    int cur_line = 0;
-    for (int i = 0; i < buf->size; ++i) {
-        ++cur_line;
-        if (cur_buf(buf)[i] - last_buf(buf)[i] > diff) {
-            cursor += sprintf(output_buf+cursor, 
-                "\e[41;37m"BYTE_TO_BINARY_PATTERN"\e[0m ", BYTE_TO_BINARY(cur_buf(buf)[i]));
-        } else if (cur_buf(buf)[i] - last_buf(buf)[i] < -diff) {
-            cursor += sprintf(output_buf+cursor, 
-                "\e[42;37m"BYTE_TO_BINARY_PATTERN"\e[0m ", BYTE_TO_BINARY(cur_buf(buf)[i]));
-        } else {
-            cursor += sprintf(output_buf+cursor, 
-                BYTE_TO_BINARY_PATTERN" ", BYTE_TO_BINARY(cur_buf(buf)[i]));
+atomic_int is_resized = 1;
+
+/*
+ * the display is a grid of cells, drawn from scratch every frame and
+ * compared with the grid the terminal shows. only changed cells go
+ * out, a run of them behind one cursor move, and the frame is sent
+ * with a single write. rows and cols are fixed at start from the
+ * device count and the format, out is sized for a frame where every
+ * cell changed.
+ */
+enum cell_attr {
+    ATTR_NONE,
+    ATTR_UP,
+    ATTR_DOWN,
+};
+
+const char* attr_codes[] = {
+    [ATTR_NONE] = "\e[0m",
+    [ATTR_UP] = "\e[41;37m",
+    [ATTR_DOWN] = "\e[42;37m",
+};
+
+struct cell {
+    char ch;
+    uint8_t attr;
+};
+
+struct screen {
+    int rows, cols;
+    int term_rows, term_cols;
+    int row, col;
+    int valid;
+    struct cell* cur;
+    struct cell* shown;
+    char* out;
+};
+
+// cursor move, color and the character itself
+#define CELL_OUT_MAX 24
+
+int screen_init(struct screen* scr, int rows, int cols) {
+    memset(scr, 0, sizeof(*scr));
+    scr->rows = rows;
+    scr->cols = cols;
+    scr->cur = calloc(rows * cols, sizeof(struct cell));
+    scr->shown = calloc(rows * cols, sizeof(struct cell));
+    scr->out = malloc((size_t)rows * cols * CELL_OUT_MAX + 64);
+    return scr->cur && scr->shown && scr->out ? 0 : -1;
+}
+
+void screen_free(struct screen* scr) {
+    free(scr->cur);
+    free(scr->shown);
+    free(scr->out);
+}
+
+void screen_begin(struct screen* scr) {
+    for (int i = 0; i < scr->rows * scr->cols; ++i)
+        scr->cur[i] = (struct cell){ ' ', ATTR_NONE };
+    scr->row = scr->col = 0;
+}
+
+// text past the last column or row is cut, tabs go to the next multiple of 8
+void screen_put(struct screen* scr, int attr, const char* text) {
+    for (; *text; ++text) {
+        if (*text == '\n') {
+            ++scr->row;
+            scr->col = 0;
+            continue;
         }
-        if (cur_line % 16 == 0) {
-            cursor += sprintf(output_buf+cursor, "\n");
-            cur_line = 0;
+        do {
+            if (scr->row < scr->rows && scr->col < scr->cols)
+                scr->cur[scr->row * scr->cols + scr->col] =
+                    (struct cell){ *text == '\t' ? ' ' : *text, attr };
+            ++scr->col;
+        } while (*text == '\t' && scr->col % 8);
+    }
+}
+
+void screen_printf(struct screen* scr, int attr, const char* fmt, ...) {
+    char text[512];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+    screen_put(scr, attr, text);
+}
+
+void screen_flush(struct screen* scr) {
+    char* p = scr->out;
+    int attr = ATTR_NONE, at_row = -1, at_col = -1;
+    int rows = scr->rows, cols = scr->cols;
+    ssize_t n;
+
+    // the terminal scrolls or wraps on anything bigger than itself
+    if (scr->term_rows > 1 && scr->term_rows - 1 < rows)
+        rows = scr->term_rows - 1;
+    if (scr->term_cols > 0 && scr->term_cols < cols)
+        cols = scr->term_cols;
+
+    if (!scr->valid)
+        p += sprintf(p, "\e[0m\e[2J");
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            struct cell* cell = &scr->cur[r * scr->cols + c];
+            struct cell* old = &scr->shown[r * scr->cols + c];
+
+            if (scr->valid ? cell->ch == old->ch && cell->attr == old->attr
+                    : cell->ch == ' ' && cell->attr == ATTR_NONE)
+                continue;
+            if (r != at_row || c != at_col)
+                p += sprintf(p, "\e[%d;%dH", r + 1, c + 1);
+            if (cell->attr != attr) {
+                p += sprintf(p, "%s", attr_codes[cell->attr]);
+                attr = cell->attr;
+            }
+            *p++ = cell->ch;
+            at_row = r;
+            at_col = c + 1;
         }
     }
-    return cursor;
+    if (attr != ATTR_NONE)
+        p += sprintf(p, "%s", attr_codes[ATTR_NONE]);
+    // leave the cursor under what was drawn
+    if (p != scr->out)
+        p += sprintf(p, "\e[%d;1H", (scr->row < rows ? scr->row : rows) + 1);
+
+    for (char* q = scr->out; q < p; q += n) {
+        n = write(STDOUT_FILENO, q, p - q);
+        if (n < 0 && errno != EINTR)
+            break;
+        if (n < 0)
+            n = 0;
+    }
+    memcpy(scr->shown, scr->cur, scr->rows * scr->cols * sizeof(struct cell));
+    scr->valid = 1;
 }
 
-int sprint_report_hex(char* output_buf, struct report_buf* buf, int diff) {
-    int cursor = 0;
+void screen_resize(struct screen* scr) {
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0) {
+        scr->term_rows = ws.ws_row;
+        scr->term_cols = ws.ws_col;
+    }
+    scr->valid = 0;
+}
+
+int format_bin(char* out, int32_t v) {
+    return sprintf(out, BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(v));
+}
+
+int format_hex(char* out, int32_t v) {
+    return sprintf(out, "%02x", v);
+}
+
+int format_dec(char* out, int32_t v) {
+    return sprintf(out, "%04d", v);
+}
+
+int format_u16(char* out, int32_t v) {
+    return sprintf(out, "%05d", v);
+}
+
+int format_s16(char* out, int32_t v) {
+    return sprintf(out, "%6d", v);
+}
+
+/*
+ * how a report is dumped: values of step bytes, per_line to a line,
+ * each width characters wide. highlighting compares the values.
+ */
+struct report_format {
+    const char* name;
+    int step;
+    int per_line;
+    int width;
+    int is_signed;
+    int (*format)(char* out, int32_t v);
+};
+
+const struct report_format report_formats[] = {
+    { "bin", 1, 16, 8, 0, format_bin },
+    { "hex", 1, 16, 2, 0, format_hex },
+    { "dec", 1, 16, 4, 1, format_dec },
+    { "u16", 2, 8, 5, 0, format_u16 },
+    { "s16", 2, 8, 6, 1, format_s16 },
+};
+
+int32_t report_value(const struct report_format* fmt, const char* data) {
+    uint32_t v = (unsigned char)data[0];
+
+    if (fmt->step == 2)
+        v |= (unsigned char)data[1] << 8;
+    if (fmt->is_signed)
+        return fmt->step == 2 ? (int16_t)v : (int8_t)v;
+    return v;
+}
+
+int report_rows(const struct report_format* fmt, int size) {
+    int values = (size + fmt->step - 1) / fmt->step;
+    return (values + fmt->per_line - 1) / fmt->per_line;
+}
+
+int diff_attr(int32_t d, int diff) {
+    if (d > diff)
+        return ATTR_UP;
+    if (d < -diff)
+        return ATTR_DOWN;
+    return ATTR_NONE;
+}
+
+void render_report(struct screen* scr, const struct report_format* fmt,
+        struct report_buf* buf, int diff) {
+    char text[16];
     int cur_line = 0;
-    for (int i = 0; i < buf->size; ++i) {
-        ++cur_line;
-        if (cur_buf(buf)[i] - last_buf(buf)[i] > diff) {
-            cursor += sprintf(output_buf+cursor, "\e[41;37m%02hhx\e[0m ", cur_buf(buf)[i]);
-        } else if (cur_buf(buf)[i] - last_buf(buf)[i] < -diff) {
-            cursor += sprintf(output_buf+cursor, "\e[42;37m%02hhx\e[0m ", cur_buf(buf)[i]);
-        } else {
-            cursor += sprintf(output_buf+cursor, "%02hhx ", cur_buf(buf)[i]);
-        }
-        if (cur_line % 16 == 0) {
-            cursor += sprintf(output_buf+cursor, "\n");
+
+    // a trailing odd byte of a 16 bit format is left out, like before
+    for (int i = 0; i + fmt->step <= buf->size; i += fmt->step) {
+        int32_t v = report_value(fmt, &cur_buf(buf)[i]);
+
+        fmt->format(text, v);
+        screen_put(scr, diff_attr(v - report_value(fmt, &last_buf(buf)[i]), diff), text);
+        screen_put(scr, ATTR_NONE, " ");
+        if (++cur_line % fmt->per_line == 0) {
+            screen_put(scr, ATTR_NONE, "\n");
             cur_line = 0;
         }
     }
-    return cursor;
 }
 
-int sprint_report_dec(char* output_buf, struct report_buf* buf, int diff) {
-    int cursor = 0;
-    int cur_line = 0;
-    for (int i = 0; i < buf->size; ++i) {
-        ++cur_line;
-        if (cur_buf(buf)[i] - last_buf(buf)[i] > diff) {
-            cursor += sprintf(output_buf+cursor, "\e[41;37m%04hhd\e[0m ", cur_buf(buf)[i]);
-        } else if (cur_buf(buf)[i] - last_buf(buf)[i] < -diff) {
-            cursor += sprintf(output_buf+cursor, "\e[42;37m%04hhd\e[0m ", cur_buf(buf)[i]);
-        } else {
-            cursor += sprintf(output_buf+cursor, "%04hhd ", cur_buf(buf)[i]);
+void render_info(struct screen* scr, char* name, struct hidraw_devinfo* info) {
+    screen_printf(scr, ATTR_NONE, "NAME: %s\n", name);
+    screen_printf(scr, ATTR_NONE, "INFO:\n");
+    screen_printf(scr, ATTR_NONE, "\tvender: \t0x%04hx\n", info->vendor);
+    screen_printf(scr, ATTR_NONE, "\tproduct: \t0x%04hx\n", info->product);
+    screen_printf(scr, ATTR_NONE, "\n");
+}
+
+/*
+ * report descriptor decoder. the descriptor is walked once and every
+ * input field becomes a flat entry: byte, shift, mask, signedness and
+ * a name. decoding a report is then a loop over those entries.
+ */
+#define PLAN_MAX_FIELDS 1024
+#define PLAN_MAX_USAGES 64
+
+struct field {
+    uint16_t byte;
+    uint8_t shift;
+    uint8_t bits;
+    uint8_t end;
+    uint8_t is_signed;
+    char name[26];
+};
+
+struct report_plan {
+    int nfields;
+    int size;
+    int header_done;
+    struct field* fields;
+};
+
+struct plan {
+    int numbered;
+    struct report_plan reports[256];
+    struct field fields[PLAN_MAX_FIELDS];
+    int nfields;
+};
+
+struct rdesc_globals {
+    uint32_t usage_page;
+    int32_t logical_min;
+    uint32_t report_size;
+    uint32_t report_count;
+    uint32_t report_id;
+};
+
+void usage_name(char* buf, int len, uint32_t usage, int index) {
+    static const char* desktop[] = {
+        [0x30] = "x", [0x31] = "y", [0x32] = "z",
+        [0x33] = "rx", [0x34] = "ry", [0x35] = "rz",
+        [0x36] = "slider", [0x37] = "dial", [0x38] = "wheel", [0x39] = "hat",
+        [0x40] = "vx", [0x41] = "vy", [0x42] = "vz",
+    };
+    uint16_t page = usage >> 16, id = usage & 0xffff;
+    int n;
+
+    if (page == 0x01 && id < sizeof(desktop) / sizeof(desktop[0]) && desktop[id])
+        n = snprintf(buf, len, "%s", desktop[id]);
+    else if (page == 0x09)
+        n = snprintf(buf, len, "btn%d", id);
+    else if (page == 0x02 && id == 0xc4)
+        n = snprintf(buf, len, "accel");
+    else if (page == 0x02 && id == 0xc5)
+        n = snprintf(buf, len, "brake");
+    else if (page >= 0xff00)
+        n = snprintf(buf, len, "vendor%x", id);
+    else
+        n = snprintf(buf, len, "u%x_%x", page, id);
+    if (index >= 0 && n < len)
+        snprintf(buf + n, len - n, "_%d", index);
+}
+
+void plan_add(struct plan* plan, int id, uint32_t bit, int bits, int is_signed,
+        uint32_t usage, int index, const char* fixed) {
+    struct field* f;
+
+    if (plan->nfields >= PLAN_MAX_FIELDS || bits > 32 || bits == 0 ||
+            bit + bits > 255 * 8)
+        return;
+    f = &plan->fields[plan->nfields++];
+    f->byte = bit / 8;
+    f->shift = bit % 8;
+    f->bits = bits;
+    f->end = (bit + bits + 7) / 8;
+    f->is_signed = is_signed;
+    if (fixed)
+        snprintf(f->name, sizeof(f->name), "%s_%d", fixed, index);
+    else
+        usage_name(f->name, sizeof(f->name), usage, index);
+    ++plan->reports[id].nfields;
+}
+
+// fields are added in descriptor order, group them by report id afterwards
+void plan_link(struct plan* plan, uint8_t* field_ids) {
+    static struct field sorted[PLAN_MAX_FIELDS];
+    int n = 0;
+
+    for (int id = 0; id < 256; ++id) {
+        plan->reports[id].fields = plan->fields + n;
+        for (int i = 0; i < plan->nfields; ++i)
+            if (field_ids[i] == id)
+                sorted[n++] = plan->fields[i];
+    }
+    memcpy(plan->fields, sorted, n * sizeof(struct field));
+}
+
+struct plan* plan_compile(const unsigned char* rdesc, int size) {
+    struct plan* plan = calloc(1, sizeof(struct plan));
+    struct rdesc_globals g, stack[4];
+    static uint32_t bits[256];
+    static uint8_t field_ids[PLAN_MAX_FIELDS];
+    uint32_t usages[PLAN_MAX_USAGES];
+    uint32_t usage_min = 0, usage_max = 0;
+    int nusages = 0, depth = 0, pads = 0;
+    const unsigned char* p = rdesc;
+    const unsigned char* end = rdesc + size;
+
+    memset(&g, 0, sizeof(g));
+    memset(bits, 0, sizeof(bits));
+
+    while (p < end) {
+        int b = *p++, len = b & 3, type = (b >> 2) & 3, tag = b >> 4;
+        uint32_t v = 0;
+        int32_t sv;
+
+        if (b == 0xfe) {
+            if (end - p < 2)
+                break;
+            p += 2 + p[0];
+            continue;
         }
-        if (cur_line % 16 == 0) {
-            cursor += sprintf(output_buf+cursor, "\n");
-            cur_line = 0;
+        if (len == 3)
+            len = 4;
+        if (end - p < len)
+            break;
+        for (int i = 0; i < len; ++i)
+            v |= (uint32_t)p[i] << (8 * i);
+        p += len;
+        sv = len == 1 ? (int8_t)v : len == 2 ? (int16_t)v : (int32_t)v;
+
+        if (type == 1) {
+            switch (tag) {
+                case 0x0: g.usage_page = v; break;
+                case 0x1: g.logical_min = sv; break;
+                case 0x7: g.report_size = v; break;
+                case 0x8:
+                    g.report_id = v & 0xff;
+                    plan->numbered = 1;
+                    break;
+                case 0x9: g.report_count = v; break;
+                case 0xa:
+                    if (depth < 4)
+                        stack[depth++] = g;
+                    break;
+                case 0xb:
+                    if (depth > 0)
+                        g = stack[--depth];
+                    break;
+            }
+        } else if (type == 2) {
+            if (len < 4)
+                v |= g.usage_page << 16;
+            if (tag == 0x0 && nusages < PLAN_MAX_USAGES)
+                usages[nusages++] = v;
+            else if (tag == 0x1)
+                usage_min = v;
+            else if (tag == 0x2)
+                usage_max = v;
+        } else if (type == 0) {
+            if (tag == 0x8) {
+                uint32_t* bit = &bits[g.report_id];
+                int base = plan->numbered ? 8 : 0;
+                int n = g.report_count;
+
+                for (int i = 0; i < n; ++i) {
+                    int before = plan->nfields;
+                    if (v & 1) {
+                        plan_add(plan, g.report_id, base + *bit, g.report_size,
+                            0, 0, pads++, "pad");
+                    } else if (!(v & 2)) {
+                        plan_add(plan, g.report_id, base + *bit, g.report_size,
+                            g.logical_min < 0, 0, i, "array");
+                    } else if (usage_max > usage_min) {
+                        uint32_t u = usage_min + i;
+                        plan_add(plan, g.report_id, base + *bit, g.report_size,
+                            g.logical_min < 0, u > usage_max ? usage_max : u,
+                            u > usage_max ? (int)(u - usage_max) : -1, NULL);
+                    } else if (nusages) {
+                        int k = i < nusages ? i : nusages - 1;
+                        plan_add(plan, g.report_id, base + *bit, g.report_size,
+                            g.logical_min < 0, usages[k],
+                            i < nusages ? -1 : i - nusages + 1, NULL);
+                    } else {
+                        plan_add(plan, g.report_id, base + *bit, g.report_size,
+                            g.logical_min < 0, g.usage_page << 16, i, NULL);
+                    }
+                    if (plan->nfields > before)
+                        field_ids[before] = g.report_id;
+                    *bit += g.report_size;
+                }
+                plan->reports[g.report_id].size = (base + *bit + 7) / 8;
+            }
+            if (tag == 0x8 || tag == 0x9 || tag == 0xa || tag == 0xb) {
+                nusages = 0;
+                usage_min = usage_max = 0;
+            }
         }
     }
-    return cursor;
+
+    plan_link(plan, field_ids);
+    return plan;
+}
+
+static inline int32_t field_get(const struct field* f, const unsigned char* data) {
+    uint64_t v = 0;
+    memcpy(&v, data + f->byte, f->end - f->byte);
+    v = (v >> f->shift) & ((1ull << f->bits) - 1);
+    if (f->is_signed && f->bits < 32 && (v >> (f->bits - 1)))
+        v |= ~0ull << f->bits;
+    return (int32_t)v;
 }
 
-int sprint_report_u16(char* output_buf, struct report_buf* buf, int diff) {
-    int cursor = 0;
+#define FIELDS_PER_LINE 6
+// "%10s %6d "
+#define FIELD_WIDTH 18
+
+void render_fields(struct screen* scr, struct report_plan* rp, struct report_buf* buf, int diff) {
     int cur_line = 0;
-    for (int i = 0; i < buf->size; i+=2) {
-        ++cur_line;
-        if (cur_buf(buf)[i] - last_buf(buf)[i] > diff) {
-            cursor += sprintf(output_buf+cursor, "\e[41;37m%05hu\e[0m ", *(__u16*)&cur_buf(buf)[i]);
-        } else if (cur_buf(buf)[i] - last_buf(buf)[i] < -diff) {
-            cursor += sprintf(output_buf+cursor, "\e[42;37m%05hu\e[0m ", *(__u16*)&cur_buf(buf)[i]);
-        } else {
-            cursor += sprintf(output_buf+cursor, "%05hu ", *(__u16*)&cur_buf(buf)[i]);
-        }
-        if (cur_line % 8 == 0) {
-            cursor += sprintf(output_buf+cursor, "\n");
+    const unsigned char* cur = (unsigned char*)cur_buf(buf);
+    const unsigned char* last = (unsigned char*)last_buf(buf);
+
+    for (int i = 0; i < rp->nfields; ++i) {
+        struct field* f = &rp->fields[i];
+        int32_t v;
+        if (f->end > buf->size)
+            break;
+        v = field_get(f, cur);
+        screen_printf(scr, ATTR_NONE, "%10s ", f->name);
+        screen_printf(scr, diff_attr(v - field_get(f, last), diff), "%6d", v);
+        screen_put(scr, ATTR_NONE, " ");
+        if (++cur_line % FIELDS_PER_LINE == 0) {
+            screen_put(scr, ATTR_NONE, "\n");
             cur_line = 0;
         }
     }
-    return cursor;
 }
-int sprint_report_s16(char* output_buf, struct report_buf* buf, int diff) {
-    int cursor = 0;
-    int cur_line = 0;
-    for (int i = 0; i < buf->size; i+=2) {
-        ++cur_line;
-        if (cur_buf(buf)[i] - last_buf(buf)[i] > diff) {
-            cursor += sprintf(output_buf+cursor, "\e[41;37m%6hd\e[0m ", *(__u16*)&cur_buf(buf)[i]);
-        } else if (cur_buf(buf)[i] - last_buf(buf)[i] < -diff) {
-            cursor += sprintf(output_buf+cursor, "\e[42;37m%6hd\e[0m ", *(__u16*)&cur_buf(buf)[i]);
-        } else {
-            cursor += sprintf(output_buf+cursor, "%6hd ", *(__u16*)&cur_buf(buf)[i]);
+
+char* csv_u64(char* p, uint64_t v) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+char* csv_s32(char* p, int32_t v) {
+    if (v < 0) {
+        *p++ = '-';
+        return csv_u64(p, -(int64_t)v);
+    }
+    return csv_u64(p, v);
+}
+
+/*
+ * one line per report: t_ns,dev,id,fields...
+ * a header line goes out the first time a device sends an id.
+ */
+void csv_report(struct plan* plan, int dev, uint64_t ns,
+        const unsigned char* data, int size) {
+    struct report_plan* rp = &plan->reports[plan->numbered ? data[0] : 0];
+    char line[PLAN_MAX_FIELDS * 12 + 64];
+    char* p = line;
+
+    if (!rp->header_done) {
+        printf("t_ns,dev,id");
+        for (int i = 0; i < rp->nfields; ++i)
+            printf(",%s", rp->fields[i].name);
+        putchar('\n');
+        rp->header_done = 1;
+    }
+
+    p = csv_u64(p, ns);
+    *p++ = ',';
+    p = csv_u64(p, dev);
+    *p++ = ',';
+    p = csv_u64(p, plan->numbered ? data[0] : 0);
+    for (int i = 0; i < rp->nfields; ++i) {
+        *p++ = ',';
+        if (rp->fields[i].end <= size)
+            p = csv_s32(p, field_get(&rp->fields[i], data));
+    }
+    *p++ = '\n';
+    fwrite(line, 1, p - line, stdout);
+}
+
+/*
+ * --analyze, activity of every bit and byte of each (device, report id)
+ * stream, to find out what the undocumented ones do.
+ *
+ * ones and toggles of all bits go through bit sliced counters: plane p
+ * of a report word holds bit p of the count of each of its 64 bits, and
+ * a report is added with a ripple carry through the planes, a few word
+ * ops per 8 bytes. changed bytes are counted bytewise in one word (swar).
+ *
+ * the per byte pass looks for counters (same non zero step as the report
+ * before) and checksums (equal to the sum or xor of the bytes before it,
+ * with or without the id), into 8 bit counters so it runs 16 bytes wide.
+ * all of these are moved to the 64 bit totals every ANA_FLUSH reports,
+ * before the 7 planes or the 8 bit counters overflow. for the correlation of every byte with the
+ * known fields below, byte times field is summed in floats over the same
+ * ANA_FLUSH reports, one contiguous loop per field the compiler turns
+ * into 4 wide multiply adds, then moved to doubles. the rounding of a
+ * block is far below what a correlation coefficient shows.
+ */
+#define ANA_MAX_SIZE 64
+#define ANA_WORDS (ANA_MAX_SIZE / 8)
+#define ANA_PLANES 7
+#define ANA_FLUSH 127
+#define ANA_MAX_STREAMS 32
+#define ANA_MAX_KNOWN 12
+#define ANA_TOP_BITS 32
+
+struct known_field {
+    uint8_t id;
+    uint8_t byte;
+    uint8_t is_s16;
+    const char* name;
+};
+
+// from the report layouts of hid-betop-t6.c
+const struct known_field known_fields[] = {
+    { 4, 2, 1, "accel_x" }, { 4, 4, 1, "accel_y" }, { 4, 6, 1, "accel_z" },
+    { 4, 8, 1, "gyro_x" }, { 4, 10, 1, "gyro_y" }, { 4, 12, 1, "gyro_z" },
+    { 5, 2, 0, "lx" }, { 5, 3, 0, "ly" }, { 5, 4, 0, "rx" }, { 5, 5, 0, "ry" },
+    { 5, 6, 0, "lt" }, { 5, 7, 0, "rt" },
+    { 5, 23, 1, "accel_x" }, { 5, 25, 1, "accel_y" }, { 5, 27, 1, "accel_z" },
+    { 5, 29, 1, "gyro_x" }, { 5, 31, 1, "gyro_y" }, { 5, 33, 1, "gyro_z" },
+};
+
+// the 24 bit button word of report 5 and the bits the driver maps
+#define ANA_BTN_BYTE 8
+#define ANA_BTN_KNOWN 0x0ff3ffu
+
+struct ana_stream {
+    int dev, id, size;
+    uint64_t reports;
+    uint64_t prev[ANA_WORDS];
+    uint64_t known[ANA_WORDS];
+    uint64_t ones_planes[ANA_WORDS][ANA_PLANES];
+    uint64_t toggle_planes[ANA_WORDS][ANA_PLANES];
+    uint64_t changed_lanes[ANA_WORDS];
+    int unflushed;
+
+    uint64_t ones[ANA_MAX_SIZE * 8];
+    uint64_t toggles[ANA_MAX_SIZE * 8];
+    uint64_t changes[ANA_MAX_SIZE];
+    uint8_t last_step[ANA_MAX_SIZE];
+    uint8_t steady_blk[ANA_MAX_SIZE];
+    uint8_t sum_blk[ANA_MAX_SIZE];
+    uint8_t xor_blk[ANA_MAX_SIZE];
+    uint64_t steady[ANA_MAX_SIZE];
+    uint64_t sum_match[ANA_MAX_SIZE];
+    uint64_t xor_match[ANA_MAX_SIZE];
+
+    int nknown;
+    const struct known_field* fields[ANA_MAX_KNOWN];
+    int unknown_bytes[ANA_MAX_SIZE];
+    int nunknown;
+    int64_t sum_f[ANA_MAX_KNOWN], sum_f2[ANA_MAX_KNOWN];
+    int64_t sum_b[ANA_MAX_SIZE], sum_b2[ANA_MAX_SIZE];
+    double sum_bf[ANA_MAX_KNOWN][ANA_MAX_SIZE];
+    float block_bf[ANA_MAX_KNOWN][ANA_MAX_SIZE];
+};
+
+struct analyzer {
+    struct ana_stream* streams[ANA_MAX_STREAMS];
+    int nstreams;
+    uint64_t reports;
+    uint64_t dropped;
+    const char* names[CAP_MAX_DEVICES];
+};
+
+struct ana_stream* ana_stream_get(struct analyzer* an, int dev, int id) {
+    struct ana_stream* st;
+
+    for (int i = 0; i < an->nstreams; ++i)
+        if (an->streams[i]->dev == dev && an->streams[i]->id == id)
+            return an->streams[i];
+    if (an->nstreams == ANA_MAX_STREAMS)
+        return NULL;
+    st = calloc(1, sizeof(*st));
+    if (!st)
+        return NULL;
+    st->dev = dev;
+    st->id = id;
+
+    // the id byte is known, so are the known fields and mapped buttons
+    st->known[0] = 0xff;
+    for (int i = 0; i < sizeof(known_fields) / sizeof(known_fields[0]); ++i) {
+        const struct known_field* f = &known_fields[i];
+        if (f->id != id || st->nknown == ANA_MAX_KNOWN)
+            continue;
+        st->fields[st->nknown++] = f;
+        for (int b = f->byte; b <= f->byte + f->is_s16; ++b)
+            st->known[b / 8] |= 0xffull << (b % 8 * 8);
+    }
+    for (int b = 0; id == 5 && b < 24; ++b) {
+        int bit = ANA_BTN_BYTE * 8 + b;
+        if (ANA_BTN_KNOWN & 1u << b)
+            st->known[bit / 64] |= 1ull << bit % 64;
+    }
+    for (int b = 0; b < ANA_MAX_SIZE; ++b)
+        if ((st->known[b / 8] >> (b % 8 * 8) & 0xff) != 0xff)
+            st->unknown_bytes[st->nunknown++] = b;
+
+    an->streams[an->nstreams++] = st;
+    return st;
+}
+
+// adds the 64 one bit values of x to the counters in planes
+static inline void ana_planes_add(uint64_t* planes, uint64_t x) {
+    // no early exit, on noisy bits the branch costs more than the planes
+    for (int p = 0; p < ANA_PLANES; ++p) {
+        uint64_t carry = planes[p] & x;
+        planes[p] ^= x;
+        x = carry;
+    }
+}
+
+static void ana_planes_flush(uint64_t* planes, uint64_t* totals) {
+    for (int p = 0; p < ANA_PLANES; ++p) {
+        for (uint64_t x = planes[p]; x; x &= x - 1)
+            totals[__builtin_ctzll(x)] += 1ull << p;
+        planes[p] = 0;
+    }
+}
+
+void ana_flush(struct ana_stream* st) {
+    for (int w = 0; w < ANA_WORDS; ++w) {
+        ana_planes_flush(st->ones_planes[w], &st->ones[w * 64]);
+        ana_planes_flush(st->toggle_planes[w], &st->toggles[w * 64]);
+        for (int b = 0; b < 8; ++b)
+            st->changes[w * 8 + b] += st->changed_lanes[w] >> (b * 8) & 0xff;
+        st->changed_lanes[w] = 0;
+    }
+    for (int b = 0; b < ANA_MAX_SIZE; ++b) {
+        st->steady[b] += st->steady_blk[b];
+        st->sum_match[b] += st->sum_blk[b];
+        st->xor_match[b] += st->xor_blk[b];
+    }
+    memset(st->steady_blk, 0, sizeof(st->steady_blk));
+    memset(st->sum_blk, 0, sizeof(st->sum_blk));
+    memset(st->xor_blk, 0, sizeof(st->xor_blk));
+    for (int k = 0; k < st->nknown; ++k) {
+        for (int b = 0; b < ANA_MAX_SIZE; ++b)
+            st->sum_bf[k][b] += st->block_bf[k][b];
+        memset(st->block_bf[k], 0, sizeof(st->block_bf[k]));
+    }
+    st->unflushed = 0;
+}
+
+void analyze_report(struct analyzer* an, int dev, const unsigned char* data, int size) {
+    struct ana_stream* st = ana_stream_get(an, dev, data[0]);
+    uint64_t cur[ANA_WORDS] = {0};
+    const uint8_t* v = (const uint8_t*)cur;
+    const uint8_t* pv;
+    uint8_t psum[ANA_MAX_SIZE], pxor[ANA_MAX_SIZE], sum = 0, x = 0;
+    int32_t f[ANA_MAX_KNOWN];
+    float vf[ANA_MAX_SIZE];
+
+    if (!st) {
+        ++an->dropped;
+        return;
+    }
+    pv = (const uint8_t*)st->prev;
+    ++an->reports;
+    if (size > ANA_MAX_SIZE)
+        size = ANA_MAX_SIZE;
+    if (size > st->size)
+        st->size = size;
+    memcpy(cur, data, size);
+    if (!st->reports)
+        memcpy(st->prev, cur, sizeof(cur));
+
+    for (int w = 0; w < (size + 7) / 8; ++w) {
+        uint64_t t = cur[w] ^ st->prev[w];
+        uint64_t c = t | t >> 4;
+
+        ana_planes_add(st->ones_planes[w], cur[w]);
+        ana_planes_add(st->toggle_planes[w], t);
+        c |= c >> 2;
+        c |= c >> 1;
+        st->changed_lanes[w] += c & 0x0101010101010101ull;
+    }
+
+    // sum and xor of the bytes before each one, the only serial part
+    for (int b = 0; b < ANA_MAX_SIZE; ++b) {
+        psum[b] = sum;
+        pxor[b] = x;
+        sum += v[b];
+        x ^= v[b];
+    }
+    for (int b = 0; b < ANA_MAX_SIZE; ++b) {
+        uint8_t step = v[b] - pv[b];
+
+        st->steady_blk[b] += step && step == st->last_step[b];
+        st->last_step[b] = step;
+        st->sum_blk[b] += v[b] == psum[b] || v[b] == (uint8_t)(psum[b] - v[0]);
+        st->xor_blk[b] += v[b] == pxor[b] || v[b] == (pxor[b] ^ v[0]);
+    }
+
+    for (int k = 0; k < st->nknown; ++k) {
+        const struct known_field* kf = st->fields[k];
+        f[k] = kf->is_s16 ? (int16_t)(data[kf->byte] | data[kf->byte + 1] << 8) : data[kf->byte];
+        st->sum_f[k] += f[k];
+        st->sum_f2[k] += (int64_t)f[k] * f[k];
+    }
+    for (int b = 0; b < ANA_MAX_SIZE; ++b) {
+        st->sum_b[b] += v[b];
+        st->sum_b2[b] += v[b] * v[b];
+        vf[b] = v[b];
+    }
+    for (int k = 0; k < st->nknown; ++k) {
+        float fk = f[k];
+        for (int b = 0; b < ANA_MAX_SIZE; ++b)
+            st->block_bf[k][b] += vf[b] * fk;
+    }
+
+    memcpy(st->prev, cur, sizeof(cur));
+    ++st->reports;
+    if (++st->unflushed == ANA_FLUSH)
+        ana_flush(st);
+}
+
+double ana_corr(struct ana_stream* st, int b, int k) {
+    double n = st->reports;
+    double vb = n * st->sum_b2[b] - (double)st->sum_b[b] * st->sum_b[b];
+    double vf = n * st->sum_f2[k] - (double)st->sum_f[k] * st->sum_f[k];
+
+    if (vb <= 0 || vf <= 0)
+        return 0;
+    return (n * st->sum_bf[k][b] - (double)st->sum_b[b] * st->sum_f[k]) / sqrt(vb * vf);
+}
+
+struct ana_rank {
+    int index;
+    uint64_t score;
+};
+
+int cmp_rank(const void* a, const void* b) {
+    uint64_t x = ((const struct ana_rank*)a)->score, y = ((const struct ana_rank*)b)->score;
+    return x < y ? 1 : x > y ? -1 : ((const struct ana_rank*)a)->index - ((const struct ana_rank*)b)->index;
+}
+
+void ana_print_stream(struct analyzer* an, struct ana_stream* st) {
+    struct ana_rank rank[ANA_MAX_SIZE * 8];
+    double n = st->reports;
+    int nrank = 0, nconst = 0;
+
+    ana_flush(st);
+    printf("== device %d%s%s, report %d: %llu reports, %d bytes\n", st->dev,
+        an->names[st->dev] ? " " : "", an->names[st->dev] ? an->names[st->dev] : "",
+        st->id, (unsigned long long)st->reports, st->size);
+
+    for (int i = 0; i < st->size * 8; ++i)
+        if (!(st->known[i / 64] >> i % 64 & 1) && st->toggles[i])
+            rank[nrank++] = (struct ana_rank){ i, st->toggles[i] };
+    qsort(rank, nrank, sizeof(rank[0]), cmp_rank);
+    printf("unknown bits that toggled, %d, most active first:\n", nrank);
+    if (nrank)
+        printf("  %-8s %12s %8s %8s\n", "byte.bit", "toggles", "toggle%", "set%");
+    for (int i = 0; i < nrank && i < ANA_TOP_BITS; ++i) {
+        int bit = rank[i].index;
+        char name[16] = "";
+
+        if (st->id == 5 && bit / 8 >= ANA_BTN_BYTE && bit / 8 < ANA_BTN_BYTE + 3)
+            snprintf(name, sizeof(name), "btn%d", bit - ANA_BTN_BYTE * 8);
+        printf("  %4d.%-3d %12llu %7.2f%% %7.2f%%  %s\n", bit / 8, bit % 8,
+            (unsigned long long)st->toggles[bit], st->toggles[bit] * 100 / n,
+            st->ones[bit] * 100 / n, name);
+    }
+
+    nrank = 0;
+    for (int u = 0; u < st->nunknown && st->unknown_bytes[u] < st->size; ++u) {
+        int b = st->unknown_bytes[u];
+        if (st->changes[b])
+            rank[nrank++] = (struct ana_rank){ b, st->changes[b] };
+        else
+            ++nconst;
+    }
+    qsort(rank, nrank, sizeof(rank[0]), cmp_rank);
+    printf("unknown bytes that changed, %d, most active first:\n", nrank);
+    if (nrank)
+        printf("  %4s %8s %8s %8s %8s  %s\n", "byte", "change%", "steady%", "sum%", "xor%",
+            "best known field (r)");
+    for (int i = 0; i < nrank; ++i) {
+        int b = rank[i].index, best = -1;
+        double r = 0, steady = st->steady[b] * 100 / n;
+        double sum = st->sum_match[b] * 100 / n, xor = st->xor_match[b] * 100 / n;
+
+        for (int k = 0; k < st->nknown; ++k) {
+            double c = ana_corr(st, b, k);
+            if (fabs(c) > fabs(r)) {
+                r = c;
+                best = k;
+            }
         }
-        if (cur_line % 8 == 0) {
-            cursor += sprintf(output_buf+cursor, "\n");
-            cur_line = 0;
+        printf("  %4d %7.2f%% %7.2f%% %7.2f%% %7.2f%%  ", b, st->changes[b] * 100 / n,
+            steady, sum, xor);
+        if (best >= 0)
+            printf("%-8s %+.3f", st->fields[best]->name, r);
+        if (steady > 90)
+            printf("  counter, step %d", st->last_step[b]);
+        if (sum > 99 || xor > 99)
+            printf("  checksum (%s)", sum > xor ? "sum" : "xor");
+        else if (fabs(r) > 0.9)
+            printf("  follows %s", st->fields[best]->name);
+        putchar('\n');
+    }
+
+    if (nconst) {
+        printf("unknown bytes that never changed, %d:\n ", nconst);
+        for (int u = 0; u < st->nunknown && st->unknown_bytes[u] < st->size; ++u) {
+            int b = st->unknown_bytes[u];
+            if (!st->changes[b])
+                printf(" %d=%02x", b, ((unsigned char*)st->prev)[b]);
         }
+        putchar('\n');
     }
-    return cursor;
+    putchar('\n');
+}
+
+void analyze_print(struct analyzer* an, double seconds) {
+    for (int i = 0; i < an->nstreams; ++i)
+        ana_print_stream(an, an->streams[i]);
+    if (an->dropped)
+        printf("%llu reports of further streams not analyzed\n", (unsigned long long)an->dropped);
+    if (seconds > 0)
+        fprintf(stderr, "analyzed %llu reports in %.3f s, %.0f reports/s\n",
+            (unsigned long long)an->reports, seconds, an->reports / seconds);
 }
 
-int sprint_info(char* output_buf, char* name, struct hidraw_devinfo* info) {
-    int cursor = 0;
-    cursor += sprintf(output_buf+cursor, "NAME: %s\n", name);
-    cursor += sprintf(output_buf+cursor, "INFO:\n");
-    cursor += sprintf(output_buf+cursor, "\tvender: \t0x%04hx\n", info->vendor);
-    cursor += sprintf(output_buf+cursor, "\tproduct: \t0x%04hx\n", info->product);
-    cursor += sprintf(output_buf+cursor, "\n");
-    return cursor;
+void analyze_free(struct analyzer* an) {
+    for (int i = 0; i < an->nstreams; ++i)
+        free(an->streams[i]);
 }
 
 void set_exit_flag(int sig) {
     is_exit = 1;
 }
 
+void set_resized_flag(int sig) {
+    is_resized = 1;
+}
+
+int is_betop(struct hidraw_devinfo* info) {
+    if ((uint16_t)info->vendor != USB_VENDOR_ID_BETOP)
+        return 0;
+    switch ((uint16_t)info->product) {
+        case USB_DEVICE_ID_BETOP_T6_USB:
+        case USB_DEVICE_ID_BETOP_T6_ADAPTER:
+        case USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO:
+        case USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO:
+            return 1;
+    }
+    return 0;
+}
+
+int open_device(struct mon_device* dev, const char* path, int quiet) {
+    memset(dev, 0, sizeof(*dev));
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+    dev->fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (dev->fd < 0) {
+        if (!quiet)
+            perror(path);
+        return -1;
+    }
+    if (ioctl(dev->fd, HIDIOCGRAWINFO, &dev->info) < 0) {
+        if (!quiet)
+            perror("HIDIOCGRAWINFO");
+        close(dev->fd);
+        return -1;
+    }
+    if (ioctl(dev->fd, HIDIOCGRAWNAME(256), dev->name) < 0)
+        perror("HIDIOCGRAWNAME");
+    return 0;
+}
+
+// every hidraw node that matches an id from hid-ids.h
+int discover_devices(struct mon_device* devs, int max) {
+    char path[32];
+    int n = 0;
+
+    for (int i = 0; i < MAX_HIDRAW && n < max; ++i) {
+        snprintf(path, sizeof(path), "/dev/hidraw%d", i);
+        if (open_device(&devs[n], path, 1))
+            continue;
+        if (is_betop(&devs[n].info))
+            ++n;
+        else
+            close(devs[n].fd);
+    }
+    return n;
+}
+
+uint64_t mono_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void cap_put(struct cap_writer* w, const void* data, size_t size) {
+    fwrite(data, 1, size, w->file);
+    w->offset += size;
+}
+
+void cap_put_u8(struct cap_writer* w, uint8_t v) {
+    cap_put(w, &v, 1);
+}
+
+void cap_put_varint(struct cap_writer* w, uint64_t v) {
+    uint8_t buf[10];
+    int n = 0;
+    do {
+        buf[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            buf[n] |= 0x80;
+        ++n;
+    } while (v);
+    cap_put(w, buf, n);
+}
+
+void cap_put_index(struct cap_writer* w, uint64_t ns) {
+    uint64_t offset = w->offset;
+
+    cap_put_u8(w, CAP_INDEX);
+    cap_put(w, &ns, 8);
+    cap_put(w, &w->reports, 8);
+    cap_put(w, &w->last_index_offset, 8);
+    w->last_index_offset = offset;
+    w->last_index_ns = ns;
+    w->last_ns = ns;
+
+    // force keyframes
+    for (int d = 0; d < CAP_MAX_DEVICES; ++d)
+        for (int i = 0; i < 256; ++i)
+            if (w->streams[d][i])
+                w->streams[d][i]->size = 0;
+    fflush(w->file);
+}
+
+struct cap_writer* cap_open(const char* path) {
+    struct cap_header header;
+    struct timespec ts;
+    struct cap_writer* w = calloc(1, sizeof(struct cap_writer));
+
+    w->file = fopen(path, "wb");
+    if (!w->file) {
+        perror("Unable to open capture file");
+        free(w);
+        return NULL;
+    }
+    setvbuf(w->file, NULL, _IOFBF, 1 << 16);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAP_MAGIC, 8);
+    header.version = CAP_VERSION;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header.start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    header.start_mono_ns = mono_ns();
+    cap_put(w, &header, sizeof(header));
+
+    cap_put_index(w, header.start_mono_ns);
+    return w;
+}
+
+void cap_put_device(struct cap_writer* w, int dev, char* name,
+        struct hidraw_devinfo* info, struct hidraw_report_descriptor* rdesc) {
+    uint8_t name_len = strnlen(name, 255);
+    uint16_t rdesc_len = rdesc ? rdesc->size : 0;
+
+    cap_put_u8(w, CAP_DEVICE);
+    cap_put_u8(w, dev);
+    cap_put(w, &info->vendor, 2);
+    cap_put(w, &info->product, 2);
+    cap_put_u8(w, name_len);
+    cap_put(w, name, name_len);
+    cap_put(w, &rdesc_len, 2);
+    if (rdesc_len)
+        cap_put(w, rdesc->value, rdesc_len);
+}
+
+void cap_put_report(struct cap_writer* w, int dev, uint64_t ns,
+        const unsigned char* data, int size) {
+    struct cap_stream* prev;
+    unsigned char mask[32];
+    int changed = 0;
+
+    if (size <= 0 || size > 255)
+        return;
+    if (ns - w->last_index_ns >= CAP_INDEX_NS)
+        cap_put_index(w, ns);
+
+    prev = w->streams[dev][data[0]];
+    if (!prev)
+        prev = w->streams[dev][data[0]] = calloc(1, sizeof(struct cap_stream));
+
+    if (prev->size == size) {
+        memset(mask, 0, sizeof(mask));
+        for (int i = 1; i < size; ++i) {
+            if (data[i] != prev->data[i]) {
+                mask[(i - 1) / 8] |= 1 << ((i - 1) % 8);
+                ++changed;
+            }
+        }
+    }
+
+    if (prev->size == size && changed + (size + 6) / 8 + 1 < size) {
+        cap_put_u8(w, CAP_DELTA);
+        cap_put_u8(w, dev);
+        cap_put_u8(w, data[0]);
+        cap_put_varint(w, ns - w->last_ns);
+        cap_put_u8(w, size);
+        cap_put(w, mask, (size + 6) / 8);
+        for (int i = 1; i < size; ++i)
+            if (mask[(i - 1) / 8] & (1 << ((i - 1) % 8)))
+                cap_put_u8(w, data[i]);
+    } else {
+        cap_put_u8(w, CAP_FULL);
+        cap_put_u8(w, dev);
+        cap_put_varint(w, ns - w->last_ns);
+        cap_put_u8(w, size);
+        cap_put(w, data, size);
+    }
+
+    prev->size = size;
+    memcpy(prev->data, data, size);
+    w->last_ns = ns;
+    ++w->reports;
+}
+
+void cap_close(struct cap_writer* w) {
+    cap_put_u8(w, CAP_END);
+    cap_put(w, &w->last_index_offset, 8);
+    fclose(w->file);
+    for (int d = 0; d < CAP_MAX_DEVICES; ++d)
+        for (int i = 0; i < 256; ++i)
+            free(w->streams[d][i]);
+    free(w);
+}
+
+struct cap_device {
+    char name[256];
+    uint16_t vendor;
+    uint16_t product;
+    uint16_t rdesc_size;
+    const unsigned char* rdesc;
+};
+
+/*
+ * memory mapped reader, decoding doesn't copy anything
+ * except the reconstructed reports.
+ */
+struct cap_reader {
+    const unsigned char* map;
+    size_t size;
+    const unsigned char* pos;
+    const struct cap_header* header;
+    uint64_t ns;
+    struct cap_device devices[CAP_MAX_DEVICES];
+    struct cap_stream* streams[CAP_MAX_DEVICES][256];
+};
+
+int cap_reader_open(struct cap_reader* r, const char* path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(r, 0, sizeof(*r));
+    if (fd < 0) {
+        perror("Unable to open capture file");
+        return -1;
+    }
+    fstat(fd, &st);
+    r->size = st.st_size;
+    if (r->size < sizeof(struct cap_header)) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        close(fd);
+        return -1;
+    }
+    r->map = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (r->map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    madvise((void*)r->map, r->size, MADV_SEQUENTIAL);
+    r->header = (const struct cap_header*)r->map;
+    if (memcmp(r->header->magic, CAP_MAGIC, 8) || r->header->version != CAP_VERSION) {
+        fprintf(stderr, "%s: not a capture file\n", path);
+        munmap((void*)r->map, r->size);
+        return -1;
+    }
+    r->pos = r->map + sizeof(struct cap_header);
+    r->ns = r->header->start_mono_ns;
+    return 0;
+}
+
+void cap_reader_close(struct cap_reader* r) {
+    munmap((void*)r->map, r->size);
+    for (int d = 0; d < CAP_MAX_DEVICES; ++d)
+        for (int i = 0; i < 256; ++i)
+            free(r->streams[d][i]);
+}
+
+uint64_t cap_get_u64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/*
+ * read a DEVICE record after its type byte,
+ * returns the end of the record or NULL if it's broken.
+ */
+const unsigned char* cap_reader_device(struct cap_reader* r, const unsigned char* p) {
+    const unsigned char* end = r->map + r->size;
+    struct cap_device* d;
+    int name_len;
+
+    if (end - p < 6 || p[0] >= CAP_MAX_DEVICES)
+        return NULL;
+    d = &r->devices[p[0]];
+    memcpy(&d->vendor, p + 1, 2);
+    memcpy(&d->product, p + 3, 2);
+    name_len = p[5];
+    p += 6;
+    if (end - p < name_len + 2)
+        return NULL;
+    memcpy(d->name, p, name_len);
+    d->name[name_len] = 0;
+    p += name_len;
+    memcpy(&d->rdesc_size, p, 2);
+    p += 2;
+    if (end - p < d->rdesc_size)
+        return NULL;
+    d->rdesc = p;
+    return p + d->rdesc_size;
+}
+
+/*
+ * jump to the last INDEX at or before ns, following the chain
+ * back from the END trailer. without a trailer (crashed recorder)
+ * just decode from the start.
+ * DEVICE records are only written before the first report,
+ * they're read here so the jump doesn't skip them.
+ */
+void cap_reader_seek(struct cap_reader* r, uint64_t ns) {
+    const unsigned char* end = r->map + r->size;
+    const unsigned char* p = r->pos;
+    uint64_t offset;
+
+    if (r->size < sizeof(struct cap_header) + 9 || end[-9] != CAP_END)
+        return;
+    while (p < end && (*p == CAP_INDEX || *p == CAP_DEVICE)) {
+        if (*p == CAP_DEVICE)
+            p = cap_reader_device(r, p + 1);
+        else
+            p = end - p >= 25 ? p + 25 : NULL;
+        // broken, let cap_reader_next() find it from the start
+        if (!p)
+            return;
+    }
+    offset = cap_get_u64(end - 8);
+    while (offset >= sizeof(struct cap_header) && offset + 25 <= r->size) {
+        p = r->map + offset;
+        if (p[0] != CAP_INDEX)
+            break;
+        if (cap_get_u64(p + 1) <= ns) {
+            r->pos = p;
+            r->ns = cap_get_u64(p + 1);
+            return;
+        }
+        offset = cap_get_u64(p + 17);
+    }
+}
+
+/*
+ * decode until the next report, returns its size, 0 at the end
+ * or -1 on a broken file. *data points into the reader's state.
+ */
+int cap_reader_next(struct cap_reader* r, int* dev, uint64_t* ns,
+        const unsigned char** data) {
+    const unsigned char* end = r->map + r->size;
+
+    while (r->pos < end) {
+        const unsigned char* p = r->pos;
+        int type = *p++;
+
+        if (type == CAP_INDEX) {
+            if (end - p < 24)
+                return -1;
+            r->ns = cap_get_u64(p);
+            r->pos = p + 24;
+        } else if (type == CAP_END) {
+            return 0;
+        } else if (type == CAP_DEVICE) {
+            p = cap_reader_device(r, p);
+            if (!p)
+                return -1;
+            r->pos = p;
+        } else if (type == CAP_FULL || type == CAP_DELTA) {
+            struct cap_stream* s;
+            uint64_t dt = 0;
+            int shift = 0, size, d, id = -1;
+
+            if (end - p < 2 || p[0] >= CAP_MAX_DEVICES)
+                return -1;
+            d = *p++;
+            if (type == CAP_DELTA)
+                id = *p++;
+            do {
+                if (p >= end || shift > 63)
+                    return -1;
+                dt |= (uint64_t)(*p & 0x7f) << shift;
+                shift += 7;
+            } while (*p++ & 0x80);
+            if (p >= end)
+                return -1;
+            size = *p++;
+
+            if (type == CAP_FULL) {
+                if (end - p < size || size == 0)
+                    return -1;
+                s = r->streams[d][p[0]];
+                if (!s)
+                    s = r->streams[d][p[0]] = calloc(1, sizeof(struct cap_stream));
+                memcpy(s->data, p, size);
+                p += size;
+            } else {
+                const unsigned char* mask = p;
+                s = r->streams[d][id];
+                if (!s || s->size != size || end - p < (size + 6) / 8)
+                    return -1;
+                p += (size + 6) / 8;
+                for (int i = 1; i < size; ++i) {
+                    if (mask[(i - 1) / 8] & (1 << ((i - 1) % 8))) {
+                        if (p >= end)
+                            return -1;
+                        s->data[i] = *p++;
+                    }
+                }
+            }
+            s->size = size;
+            r->ns += dt;
+            r->pos = p;
+            *dev = d;
+            *ns = r->ns;
+            *data = s->data;
+            return size;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int play(const char* path, double seek, int dump, int csv, int analyze) {
+    static struct analyzer an;
+    struct cap_reader r;
+    const unsigned char* data;
+    uint64_t ns, first = 0, last = 0, target = 0, count = 0;
+    static uint64_t per_id[CAP_MAX_DEVICES][256];
+    struct plan* plans[CAP_MAX_DEVICES] = {0};
+    const unsigned char* pos;
+    size_t decoded = 0;
+    uint64_t start;
+    double decode_s;
+    int dev, size;
+
+    if (cap_reader_open(&r, path))
+        return 1;
+    if (seek > 0) {
+        target = r.header->start_mono_ns + seek * 1e9;
+        cap_reader_seek(&r, target);
+    }
+
+    start = mono_ns();
+    pos = r.pos;
+    while ((size = cap_reader_next(&r, &dev, &ns, &data)) > 0) {
+        if (ns < target) {
+            pos = r.pos;
+            continue;
+        }
+        if (!count)
+            first = ns;
+        decoded += r.pos - pos;
+        pos = r.pos;
+        last = ns;
+        ++count;
+        ++per_id[dev][data[0]];
+        if (analyze) {
+            analyze_report(&an, dev, data, size);
+        } else if (csv) {
+            if (!plans[dev])
+                plans[dev] = plan_compile(r.devices[dev].rdesc, r.devices[dev].rdesc_size);
+            csv_report(plans[dev], dev, ns, data, size);
+        } else if (dump) {
+            for (int i = 0; i < size; ++i)
+                printf("%02hhx ", data[i]);
+            putchar('\n');
+        }
+    }
+    decode_s = (mono_ns() - start) / 1e9;
+    if (size < 0)
+        fprintf(stderr, "broken record at offset %zu, stopped there\n",
+            (size_t)(r.pos - r.map));
+
+    if (analyze) {
+        for (int d = 0; d < CAP_MAX_DEVICES; ++d)
+            if (r.devices[d].vendor)
+                an.names[d] = r.devices[d].name;
+        analyze_print(&an, decode_s);
+        analyze_free(&an);
+    } else if (csv) {
+        fflush(stdout);
+        fprintf(stderr, "decoded %llu reports in %.3f s, %.0f reports/s\n",
+            (unsigned long long)count, decode_s, decode_s > 0 ? count / decode_s : 0);
+    } else if (!dump) {
+        double span = count ? (last - first) / 1e9 : 0;
+
+        for (int d = 0; d < CAP_MAX_DEVICES; ++d) {
+            if (!r.devices[d].vendor)
+                continue;
+            printf("DEVICE %d: %s\n", d, r.devices[d].name);
+            printf("\tvender: \t0x%04hx\n", r.devices[d].vendor);
+            printf("\tproduct: \t0x%04hx\n", r.devices[d].product);
+            for (int i = 0; i < 256; ++i)
+                if (per_id[d][i])
+                    printf("\tid %d: \t%llu, %.1f/s\n", i,
+                        (unsigned long long)per_id[d][i],
+                        span > 0 ? per_id[d][i] / span : 0);
+        }
+        printf("\nreports: %llu in %.3f s\n", (unsigned long long)count, span);
+        // only what was decoded, a seek skips part of the file
+        printf("file: %zu bytes, %.1f bytes/report\n", r.size,
+            count ? (double)decoded / count : 0);
+        printf("decode: %.3f s, %.0f reports/s\n", decode_s,
+            decode_s > 0 ? count / decode_s : 0);
+    }
+
+    for (int d = 0; d < CAP_MAX_DEVICES; ++d)
+        free(plans[d]);
+    cap_reader_close(&r);
+    return size < 0;
+}
+
+struct ring_slot* ring_next(struct ring* ring) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= RING_SIZE)
+        return NULL;
+    return &ring->slots[head % RING_SIZE];
+}
+
+void ring_push(struct ring* ring) {
+    atomic_fetch_add_explicit(&ring->head, 1, memory_order_release);
+}
+
+// read everything queued on one device, returns -1 once it is gone
+int read_device(struct reader* rd, int index) {
+    struct mon_device* dev = &rd->devs[index];
+    struct ring_slot* slot;
+    unsigned char scratch[256];
+    int res, queued = 0;
+
+    while (1) {
+        slot = ring_next(rd->ring);
+        res = read(dev->fd, slot ? slot->data : scratch, 256);
+        if (res < 0 && errno == EAGAIN)
+            break;
+        if (res <= 0) {
+            if (res < 0 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        ++queued;
+        if (!slot) {
+            atomic_fetch_add_explicit(&dev->ring_drops, 1, memory_order_relaxed);
+            continue;
+        }
+        slot->ns = mono_ns();
+        slot->dev = index;
+        slot->size = res;
+        ring_push(rd->ring);
+    }
+
+    /*
+     * only a hint: a full queue's worth in one go means the kernel may have
+     * dropped reports, but it can also be exactly full, and more reports
+     * can arrive while draining. hidraw doesn't say when it drops.
+     */
+    if (queued >= HIDRAW_QUEUE)
+        atomic_fetch_add_explicit(&dev->maybe_overflow, 1, memory_order_relaxed);
+    return 0;
+}
+
+void* reader_main(void* arg) {
+    struct reader* rd = arg;
+    struct epoll_event events[MAX_DEVICES];
+    uint64_t one = 1;
+    int alive = rd->ndev;
+    int res;
+
+    while (!is_exit && alive) {
+        res = epoll_wait(rd->epfd, events, MAX_DEVICES, 100);
+        if (res < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < res; ++i) {
+            int index = events[i].data.u32;
+            struct mon_device* dev = &rd->devs[index];
+            struct ring_slot* slot;
+
+            if (read_device(rd, index) == 0)
+                continue;
+            fprintf(stderr, "%s: read error, closing\n", dev->path);
+            epoll_ctl(rd->epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+            close(dev->fd);
+            dev->fd = -1;
+            --alive;
+            while (!(slot = ring_next(rd->ring)) && !is_exit)
+                usleep(1000);
+            if (slot) {
+                slot->dev = index;
+                slot->size = 0;
+                ring_push(rd->ring);
+            }
+        }
+        if (res > 0)
+            write(rd->ring->efd, &one, sizeof(one));
+    }
+
+    atomic_store(&rd->done, 1);
+    write(rd->ring->efd, &one, sizeof(one));
+    return NULL;
+}
+
+void consume_report(struct mon_device* dev, struct ring_slot* slot,
+        struct cap_writer* writer, int csv) {
+    if (writer)
+        cap_put_report(writer, slot->dev, slot->ns, slot->data, slot->size);
+    if (csv)
+        csv_report(dev->plan, slot->dev, slot->ns, slot->data, slot->size);
+
+    ++dev->reports;
+    if (slot->data[0] == 4) {
+        ++dev->reports4;
+        dev->pending4_size = slot->size;
+        memcpy(dev->pending4, slot->data, slot->size);
+    } else if (slot->data[0] == 5) {
+        ++dev->reports5;
+        dev->pending5_size = slot->size;
+        memcpy(dev->pending5, slot->data, slot->size);
+    }
+}
+
+void show_pending(struct report_buf* buf, char* pending, int* pending_size) {
+    if (!*pending_size)
+        return;
+    buf->size = *pending_size;
+    buf->index = (buf->index + 1) % 2;
+    memcpy(cur_buf(buf), pending, *pending_size);
+    *pending_size = 0;
+}
+
 int main(int argc, char** argv) {
-    int fd;
     int diff = 0;
-    int cursor=0;
-    int res, rep4_size, rep5_size;
-    char input_buf[256];
-    char output_buf[1024];
-    struct report_buf *buf4, *buf5;
-    char name[256];
-    struct hidraw_devinfo info;
+    int epfd, ndev = 0;
+    struct screen scr;
+    int rows = 0, cols = 0;
+    uint64_t fresh = 0;
+    struct mon_device devs[MAX_DEVICES];
+    char* paths[MAX_DEVICES];
+    int npaths = 0;
     double interval = 0.1;
-    char* device = "/dev/hidraw0";
+    char* record = NULL;
+    char* playback = NULL;
+    double seek = 0;
+    int dump = 0;
+    int fields = 0;
+    int csv = 0;
+    int analyze = 0;
+    static struct analyzer an;
+    struct cap_writer* writer = NULL;
+    struct hidraw_report_descriptor rdesc;
+    static struct ring ring;
+    struct reader rd;
+    pthread_t reader_thread;
+    uint64_t last_show, now, tail, count;
     
-    int (*sprint_report)(char*, struct report_buf*, int) = sprint_report_hex;
+    const struct report_format* format = &report_formats[1];
     
     while(1) {
         int c = getopt_long(argc, argv, optstring, options, NULL);
@@ -181,7 +1718,8 @@ int main(int argc, char** argv) {
         }
         switch (c) {
             case 'p':
-                device = optarg;
+                if (npaths < MAX_DEVICES)
+                    paths[npaths++] = optarg;
                 break;
             case 'd':
                 diff = atoi(optarg);
@@ -190,101 +1728,237 @@ int main(int argc, char** argv) {
                 interval = atof(optarg);
                 break;
             case 'f':
-                if (strcmp("bin", optarg) == 0)
-                    sprint_report = sprint_report_bin;
-                if (strcmp("dec", optarg) == 0)
-                    sprint_report = sprint_report_dec;
-                if (strcmp("u16", optarg) == 0)
-                    sprint_report = sprint_report_u16;
-                if (strcmp("s16", optarg) == 0)
-                    sprint_report = sprint_report_s16;
+                for (int i = 0; i < sizeof(report_formats) / sizeof(report_formats[0]); ++i)
+                    if (strcmp(report_formats[i].name, optarg) == 0)
+                        format = &report_formats[i];
+                if (strcmp("fields", optarg) == 0)
+                    fields = 1;
 
+                break;
+            case 'r':
+                record = optarg;
+                break;
+            case 'y':
+                playback = optarg;
+                break;
+            case 's':
+                seek = atof(optarg);
+                break;
+            case 'D':
+                dump = 1;
+                break;
+            case 'c':
+                csv = 1;
+                break;
+            case 'a':
+                analyze = 1;
                 break;
             default:
                 break;
         }
     }
     
+    if (playback)
+        return play(playback, seek, dump, csv, analyze);
+
     signal(SIGINT, set_exit_flag);
 
-    fd = open(device, O_RDONLY);
+    if (npaths) {
+        for (int i = 0; i < npaths; ++i) {
+            if (open_device(&devs[ndev], paths[i], 0))
+                return 1;
+            ++ndev;
+        }
+    } else {
+        ndev = discover_devices(devs, MAX_DEVICES);
+        if (!ndev) {
+            fprintf(stderr, "no betop hidraw device found, use --hidraw\n");
+            return 1;
+        }
+    }
 
-    if (fd < 0) {
-        perror("Unable to open this device");
+    epfd = epoll_create1(0);
+    if (epfd < 0) {
+        perror("epoll_create1");
         return 1;
     }
-    
-    buf4 = malloc(sizeof(struct report_buf));
-    buf5 = malloc(sizeof(struct report_buf));
-    
-    memset(input_buf, 0, sizeof(input_buf));
-    memset(output_buf, 0, sizeof(output_buf));
-    memset(buf4, 0, sizeof(struct report_buf));
-    memset(buf5, 0, sizeof(struct report_buf));
-    memset(name, 0, sizeof(name));
-    memset(&info, 0, sizeof(info));
-    
-    res = ioctl(fd, HIDIOCGRAWNAME(256), name);
-    if (res < 0) {
-        perror("HIDIOCGRAWNAME");
+    for (int i = 0; i < ndev; ++i) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, devs[i].fd, &ev) < 0) {
+            perror("epoll_ctl");
+            return 1;
+        }
     }
 
-    res = ioctl(fd, HIDIOCGRAWINFO, &info);
-    if (res < 0) {
-        perror("HIDIOCGRAWINFO");
-        return 1;
+    if (record) {
+        writer = cap_open(record);
+        if (!writer)
+            return 1;
     }
-    
+    if (csv)
+        setvbuf(stdout, NULL, _IOFBF, 1 << 16);
 
-    struct timeval last, cur;
-    memset(&cur, 0, sizeof(struct timeval));
-    memset(&last, 0, sizeof(struct timeval));
+    for (int i = 0; i < ndev; ++i) {
+        memset(&rdesc, 0, sizeof(rdesc));
+        if (ioctl(devs[i].fd, HIDIOCGRDESCSIZE, &rdesc.size) < 0 ||
+                ioctl(devs[i].fd, HIDIOCGRDESC, &rdesc) < 0) {
+            perror("HIDIOCGRDESC");
+            rdesc.size = 0;
+        }
+        devs[i].plan = plan_compile(rdesc.value, rdesc.size);
+        if (writer)
+            cap_put_device(writer, i, devs[i].name, &devs[i].info, &rdesc);
+    }
 
-    while (!is_exit) {
-        res = read(fd, input_buf, sizeof(input_buf));
-        if (res < 0) {
-            perror("read error");
+    /*
+     * per device: path, 5 info lines, rate, drops, then id, dump and a
+     * blank line for both reports. dumps are sized for the largest report
+     * hidraw hands out, fields for what the descriptor declares.
+     */
+    for (int i = 0; i < ndev; ++i) {
+        rows += 8;
+        for (int id = 4; id <= 5; ++id) {
+            if (fields)
+                rows += 2 + (devs[i].plan->reports[id].nfields + FIELDS_PER_LINE - 1) / FIELDS_PER_LINE;
+            else
+                rows += 2 + report_rows(format, sizeof(devs[i].pending4));
+        }
+        if (cols < strlen(devs[i].name) + 6)
+            cols = strlen(devs[i].name) + 6;
+    }
+    if (cols < 80)
+        cols = 80;
+    if (fields && cols < FIELDS_PER_LINE * FIELD_WIDTH)
+        cols = FIELDS_PER_LINE * FIELD_WIDTH;
+    if (!fields && cols < format->per_line * (format->width + 1))
+        cols = format->per_line * (format->width + 1);
+    if (analyze) {
+        for (int i = 0; i < ndev; ++i)
+            an.names[i] = devs[i].name;
+        fprintf(stderr, "analyzing, ctrl-c prints the report\n");
+    } else if (!csv) {
+        if (screen_init(&scr, rows, cols)) {
+            perror("screen_init");
             return 1;
         }
+        signal(SIGWINCH, set_resized_flag);
+    }
+
+    ring.efd = eventfd(0, EFD_NONBLOCK);
+    if (ring.efd < 0) {
+        perror("eventfd");
+        return 1;
+    }
+    rd.ring = &ring;
+    rd.devs = devs;
+    rd.ndev = ndev;
+    rd.epfd = epfd;
+    atomic_init(&rd.done, 0);
+    if (pthread_create(&reader_thread, NULL, reader_main, &rd)) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    last_show = mono_ns();
+    while (1) {
+        struct pollfd pfd = { .fd = ring.efd, .events = POLLIN };
+        int done = atomic_load(&rd.done);
+
+        tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+        while (tail != atomic_load_explicit(&ring.head, memory_order_acquire)) {
+            struct ring_slot* slot = &ring.slots[tail % RING_SIZE];
+            if (slot->size) {
+                consume_report(&devs[slot->dev], slot, writer, csv);
+                if (analyze)
+                    analyze_report(&an, slot->dev, slot->data, slot->size);
+                ++fresh;
+            } else
+                devs[slot->dev].gone = 1;
+            atomic_store_explicit(&ring.tail, ++tail, memory_order_release);
+        }
+        if (done)
+            break;
 
-        gettimeofday(&cur, NULL);
-        if ((cur.tv_sec - last.tv_sec + (cur.tv_usec - last.tv_usec)/1000000.0) < interval)
+        // with -n 0 a frame goes out for every batch of new reports
+        now = mono_ns();
+        if (csv || analyze || (now - last_show) / 1e9 < interval || (interval <= 0 && !fresh)) {
+            int timeout = csv || analyze || interval <= 0 ? 100 : interval * 1000 - (now - last_show) / 1000000;
+            if (poll(&pfd, 1, timeout) > 0)
+                read(ring.efd, &count, sizeof(count));
             continue;
-        
-        if (input_buf[0] == 4) {
-            buf4->size = res;
-            buf4->index = (buf4->index + 1) % 2;
-            memcpy(cur_buf(buf4), input_buf, sizeof(cur_buf(buf4)));
-        } else if (input_buf[0] == 5) {
-            buf5->size = res;
-            buf5->index = (buf5->index + 1) % 2;
-            memcpy(cur_buf(buf5), input_buf, sizeof(cur_buf(buf5)));
         }
-        
-        // if (cur_buf(buf4)[0] == 0 || cur_buf(buf5)[0] == 0) {
-        //     continue;
-        // }
-        
-        
-        puts("\033[2J\033[1;1H");
-        cursor += sprint_info(output_buf + cursor, name, &info);
-        cursor += sprintf(output_buf+cursor, "Report ID: 4\n");
-        cursor += sprint_report(output_buf + cursor, buf4, diff);
-        cursor += sprintf(output_buf+cursor, "\n");
-        cursor += sprintf(output_buf+cursor, "Report ID: 5\n");
-        cursor += sprint_report(output_buf + cursor, buf5, diff);
-        puts(output_buf);
-        fflush(stdout);
-        
-        cur_buf(buf4)[0] = 0;
-        cur_buf(buf5)[0] = 0;
-        cursor = 0;
-        last = cur;
+        fresh = 0;
+
+        if (is_resized) {
+            is_resized = 0;
+            screen_resize(&scr);
+        }
+        screen_begin(&scr);
+        for (int i = 0; i < ndev; ++i) {
+            struct mon_device* dev = &devs[i];
+            double dt = (now - last_show) / 1e9;
+
+            show_pending(&dev->buf4, dev->pending4, &dev->pending4_size);
+            show_pending(&dev->buf5, dev->pending5, &dev->pending5_size);
+
+            screen_printf(&scr, ATTR_NONE, "%s%s\n", dev->path,
+                dev->gone ? " (gone)" : "");
+            render_info(&scr, dev->name, &dev->info);
+            screen_printf(&scr, ATTR_NONE,
+                "RATE: %.0f/s (id 4: %.0f/s, id 5: %.0f/s), %llu reports\n",
+                (dev->reports - dev->shown) / dt,
+                (dev->reports4 - dev->shown4) / dt,
+                (dev->reports5 - dev->shown5) / dt,
+                (unsigned long long)dev->reports);
+            screen_printf(&scr, ATTR_NONE, "DROPS: %llu ring full, %llu possible hidraw overflows\n",
+                (unsigned long long)atomic_load_explicit(&dev->ring_drops, memory_order_relaxed),
+                (unsigned long long)atomic_load_explicit(&dev->maybe_overflow, memory_order_relaxed));
+            dev->shown = dev->reports;
+            dev->shown4 = dev->reports4;
+            dev->shown5 = dev->reports5;
+
+            screen_printf(&scr, ATTR_NONE, "Report ID: 4\n");
+            if (fields)
+                render_fields(&scr, &dev->plan->reports[4], &dev->buf4, diff);
+            else
+                render_report(&scr, format, &dev->buf4, diff);
+            screen_printf(&scr, ATTR_NONE, "\n");
+            screen_printf(&scr, ATTR_NONE, "Report ID: 5\n");
+            if (fields)
+                render_fields(&scr, &dev->plan->reports[5], &dev->buf5, diff);
+            else
+                render_report(&scr, format, &dev->buf5, diff);
+            screen_printf(&scr, ATTR_NONE, "\n");
+        }
+        screen_flush(&scr);
+
+        last_show = now;
     }
     
-    puts("\nexiting");
-    free(buf4);
-    free(buf5);
-    close(fd);
+    pthread_join(reader_thread, NULL);
+    for (int i = 0; i < ndev; ++i) {
+        uint64_t drops = atomic_load(&devs[i].ring_drops);
+        uint64_t maybe = atomic_load(&devs[i].maybe_overflow);
+        if (drops || maybe)
+            fprintf(stderr, "%s: %llu reports dropped on a full ring, "
+                "%llu possible hidraw queue overflows\n", devs[i].path,
+                (unsigned long long)drops, (unsigned long long)maybe);
+    }
+    if (analyze) {
+        analyze_print(&an, 0);
+        analyze_free(&an);
+    } else if (!csv) {
+        puts("\nexiting");
+        screen_free(&scr);
+    }
+    if (writer)
+        cap_close(writer);
+    for (int i = 0; i < ndev; ++i) {
+        if (devs[i].fd >= 0)
+            close(devs[i].fd);
+        free(devs[i].plan);
+    }
+    close(epfd);
+    close(ring.efd);
     return 0;
-}
\ No newline at end of file
+}
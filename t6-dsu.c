@@ -0,0 +1,747 @@
+/*
+ * cemuhook (DSU) motion server for hid-betop-t6.
+ *
+ * serves the "Betop T6 ... IMU" evdev devices over udp like evdevhook does
+ * with evdevhook-config/betop-t6.json, without a generic process in between:
+ * the devices are read in batches from one epoll loop, every SYN_REPORT
+ * becomes one pad data packet stamped with the driver's MSC_TIMESTAMP and
+ * goes straight to the subscribed clients. packets live in the slot, the
+ * per sample work is six multiplies and a crc.
+ *
+ * --client runs a minimal DSU client instead, it subscribes to all slots,
+ * prints the rate and latest motion per slot and checks crc and packet
+ * numbers, enough to test a server on the same machine.
+ */
+
+#include "hid-ids.h"
+
+#include <linux/input.h>
+#include <getopt.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <glob.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define DSU_PORT 26760
+#define DSU_VERSION 1001
+#define DSU_SLOTS 4
+#define MAX_CLIENTS 16
+// clients renew their subscription about once a second
+#define CLIENT_TIMEOUT_NS 5000000000ull
+#define RESCAN_MS 2000
+
+#define MSG_VERSION 0x100000
+#define MSG_PORTS 0x100001
+#define MSG_DATA 0x100002
+
+#define HEADER_SIZE 16
+#define VERSION_SIZE 22
+#define PORTS_SIZE 32
+#define DATA_SIZE 100
+#define REQUEST_SIZE 20
+#define DATA_REQUEST_SIZE 28
+#define MAX_PACKET 128
+
+#define STATE_CONNECTED 2
+#define MODEL_FULL_GYRO 2
+#define CONNECTION_USB 1
+#define CONNECTION_BT 2
+
+// offsets into the pad data packet
+#define DATA_PACKET_NUM 32
+#define DATA_STICKS 40
+#define DATA_TIMESTAMP 68
+#define DATA_ACCEL 76
+
+#define IMU_AXES 6
+
+/*
+ * output axis i of a sensor comes from input axis src[i] times sign[i],
+ * "y+z-x+" is x = +y, y = -z, z = +x in the DSU frame, same notation as
+ * evdevhook.
+ */
+struct axis_map {
+    int src[3];
+    int sign[3];
+};
+
+struct dsu_device {
+    int fd;
+    char path[32];
+    char name[256];
+    int wireless;
+    // evdev value index and scale for each DSU motion value
+    int src[IMU_AXES];
+    float mul[IMU_AXES];
+    int32_t value[IMU_AXES];
+    uint32_t last_ts;
+    uint64_t ts_high;
+    uint32_t packet_num;
+    unsigned char packet[DATA_SIZE];
+    uint64_t frames, sent, send_errors;
+};
+
+struct dsu_client {
+    struct sockaddr_in addr;
+    uint64_t until[DSU_SLOTS];
+};
+
+struct axis_map accel_map = { {1, 2, 0}, {1, -1, 1} };
+struct axis_map gyro_map = { {1, 2, 0}, {-1, -1, 1} };
+float gyro_sensitivity = 0.858f;
+
+struct dsu_device slots[DSU_SLOTS];
+struct dsu_client clients[MAX_CLIENTS];
+uint32_t server_id;
+uint32_t crc_table[256];
+
+atomic_int is_exit = 0;
+
+char optstring[] = "b:p:a:g:s:c";
+struct option options[] = {
+    {"bind", required_argument, 0, 'b'},
+    {"port", required_argument, 0, 'p'},
+    {"accel", required_argument, 0, 'a'},
+    {"gyro", required_argument, 0, 'g'},
+    {"sensitivity", required_argument, 0, 's'},
+    {"client", no_argument, 0, 'c'},
+    {0, 0, 0, 0},
+};
+
+void set_exit_flag(int sig) {
+    is_exit = 1;
+}
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void crc_init() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+uint32_t crc32(const unsigned char* p, int size) {
+    uint32_t c = 0xffffffff;
+    for (int i = 0; i < size; ++i)
+        c = crc_table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffff;
+}
+
+// the protocol is little endian
+void put_u16(unsigned char* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+void put_u32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+        p[i] = v >> (i * 8);
+}
+
+void put_u64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i)
+        p[i] = v >> (i * 8);
+}
+
+void put_float(unsigned char* p, float f) {
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    put_u32(p, v);
+}
+
+uint32_t get_u32(const unsigned char* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+uint64_t get_u64(const unsigned char* p) {
+    return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+float get_float(const unsigned char* p) {
+    uint32_t v = get_u32(p);
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+}
+
+void dsu_header(unsigned char* p, const char* magic, int size, uint32_t type) {
+    memcpy(p, magic, 4);
+    put_u16(p + 4, DSU_VERSION);
+    put_u16(p + 6, size - HEADER_SIZE);
+    put_u32(p + 12, server_id);
+    put_u32(p + 16, type);
+}
+
+void dsu_finish(unsigned char* p, int size) {
+    put_u32(p + 8, 0);
+    put_u32(p + 8, crc32(p, size));
+}
+
+int dsu_check(unsigned char* p, int size, const char* magic) {
+    uint32_t crc;
+
+    if (size < REQUEST_SIZE || memcmp(p, magic, 4))
+        return 0;
+    if (HEADER_SIZE + (p[6] | p[7] << 8) > size)
+        return 0;
+    crc = get_u32(p + 8);
+    put_u32(p + 8, 0);
+    return crc32(p, size) == crc;
+}
+
+int parse_axis_map(const char* s, struct axis_map* map) {
+    if (strlen(s) != 6)
+        return -1;
+    for (int i = 0; i < 3; ++i) {
+        if (s[i * 2] < 'x' || s[i * 2] > 'z')
+            return -1;
+        if (s[i * 2 + 1] != '+' && s[i * 2 + 1] != '-')
+            return -1;
+        map->src[i] = s[i * 2] - 'x';
+        map->sign[i] = s[i * 2 + 1] == '+' ? 1 : -1;
+    }
+    return 0;
+}
+
+// shared beginning of port info and pad data
+void put_slot_info(unsigned char* p, int slot) {
+    struct dsu_device* dev = &slots[slot];
+
+    p[0] = slot;
+    p[1] = dev->fd >= 0 ? STATE_CONNECTED : 0;
+    p[2] = dev->fd >= 0 ? MODEL_FULL_GYRO : 0;
+    p[3] = dev->fd < 0 ? 0 : dev->wireless ? CONNECTION_BT : CONNECTION_USB;
+    memset(p + 4, 0, 6);
+    if (dev->fd >= 0)
+        p[9] = slot + 1;
+    // battery not applicable
+    p[10] = 0;
+}
+
+int read_abs_res(int fd, int code) {
+    struct input_absinfo info;
+
+    if (ioctl(fd, EVIOCGABS(code), &info) < 0 || info.resolution <= 0)
+        return 1;
+    return info.resolution;
+}
+
+/*
+ * accel is reported in g and gyro in deg/s, the evdev resolutions are
+ * units per g and units per deg/s.
+ */
+void setup_device(struct dsu_device* dev, int slot) {
+    unsigned char* p = dev->packet;
+    int accel_res = read_abs_res(dev->fd, ABS_X);
+    int gyro_res = read_abs_res(dev->fd, ABS_RX);
+
+    for (int i = 0; i < 3; ++i) {
+        dev->src[i] = accel_map.src[i];
+        dev->mul[i] = (float)accel_map.sign[i] / accel_res;
+        dev->src[3 + i] = 3 + gyro_map.src[i];
+        dev->mul[3 + i] = gyro_map.sign[i] * gyro_sensitivity / gyro_res;
+    }
+    for (int i = 0; i < IMU_AXES; ++i) {
+        struct input_absinfo info;
+        if (ioctl(dev->fd, EVIOCGABS(ABS_X + i), &info) == 0)
+            dev->value[i] = info.value;
+    }
+    dev->last_ts = 0;
+    dev->ts_high = 0;
+    dev->packet_num = 0;
+    dev->frames = dev->sent = dev->send_errors = 0;
+
+    memset(p, 0, DATA_SIZE);
+    dsu_header(p, "DSUS", DATA_SIZE, MSG_DATA);
+    put_slot_info(p + 20, slot);
+    p[31] = 1;
+    memset(p + DATA_STICKS, 128, 4);
+}
+
+int is_betop_imu(const char* name) {
+    size_t len = strlen(name);
+    return strncmp(name, "Betop T6 ", 9) == 0 && len > 4
+        && strcmp(name + len - 4, " IMU") == 0;
+}
+
+void scan_devices() {
+    glob_t g;
+    char path[32], name[256];
+    int slot, num, fd;
+    struct input_id id;
+
+    if (glob("/sys/class/input/event*/device/name", 0, NULL, &g))
+        return;
+    for (size_t i = 0; i < g.gl_pathc; ++i) {
+        FILE* f = fopen(g.gl_pathv[i], "r");
+
+        if (!f)
+            continue;
+        name[0] = 0;
+        fgets(name, sizeof(name), f);
+        fclose(f);
+        name[strcspn(name, "\n")] = 0;
+        if (!is_betop_imu(name))
+            continue;
+        if (sscanf(g.gl_pathv[i], "/sys/class/input/event%d/", &num) != 1)
+            continue;
+        snprintf(path, sizeof(path), "/dev/input/event%d", num);
+
+        for (slot = 0; slot < DSU_SLOTS; ++slot)
+            if (slots[slot].fd >= 0 && strcmp(slots[slot].path, path) == 0)
+                break;
+        if (slot < DSU_SLOTS)
+            continue;
+        for (slot = 0; slot < DSU_SLOTS && slots[slot].fd >= 0; ++slot)
+            ;
+        if (slot == DSU_SLOTS)
+            break;
+
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        if (ioctl(fd, EVIOCGID, &id) < 0 || id.vendor != USB_VENDOR_ID_BETOP) {
+            close(fd);
+            continue;
+        }
+        slots[slot].fd = fd;
+        snprintf(slots[slot].path, sizeof(slots[slot].path), "%s", path);
+        snprintf(slots[slot].name, sizeof(slots[slot].name), "%s", name);
+        slots[slot].wireless = strstr(name, "Adapter") != NULL;
+        setup_device(&slots[slot], slot);
+        printf("slot %d: %s (%s)\n", slot, name, path);
+    }
+    globfree(&g);
+}
+
+void close_slot(int epfd, int slot) {
+    struct dsu_device* dev = &slots[slot];
+
+    printf("slot %d: %s gone, %llu frames, %llu packets sent\n", slot, dev->name,
+        (unsigned long long)dev->frames, (unsigned long long)dev->sent);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+    close(dev->fd);
+    dev->fd = -1;
+}
+
+void send_frame(int sock, struct dsu_device* dev, int slot, uint64_t now) {
+    unsigned char* p = dev->packet;
+    int subscribed = 0;
+
+    ++dev->frames;
+    for (int i = 0; i < MAX_CLIENTS; ++i)
+        subscribed |= clients[i].until[slot] > now;
+    if (!subscribed)
+        return;
+
+    put_u32(p + DATA_PACKET_NUM, dev->packet_num++);
+    put_u64(p + DATA_TIMESTAMP, dev->ts_high | dev->last_ts);
+    for (int i = 0; i < IMU_AXES; ++i)
+        put_float(p + DATA_ACCEL + i * 4, dev->value[dev->src[i]] * dev->mul[i]);
+    dsu_finish(p, DATA_SIZE);
+
+    for (int i = 0; i < MAX_CLIENTS; ++i) {
+        if (clients[i].until[slot] <= now)
+            continue;
+        if (sendto(sock, p, DATA_SIZE, MSG_DONTWAIT,
+                (struct sockaddr*)&clients[i].addr, sizeof(clients[i].addr)) == DATA_SIZE)
+            ++dev->sent;
+        else
+            ++dev->send_errors;
+    }
+}
+
+/*
+ * one read takes whatever the device has queued, a frame is sent on
+ * each SYN_REPORT in it.
+ */
+int read_device(int sock, int slot) {
+    struct dsu_device* dev = &slots[slot];
+    struct input_event evs[64];
+    ssize_t res;
+    uint64_t now = now_ns();
+
+    while ((res = read(dev->fd, evs, sizeof(evs))) > 0) {
+        for (int i = 0; i < res / sizeof(evs[0]); ++i) {
+            struct input_event* ev = &evs[i];
+
+            if (ev->type == EV_ABS && ev->code <= ABS_RZ) {
+                dev->value[ev->code] = ev->value;
+            } else if (ev->type == EV_MSC && ev->code == MSC_TIMESTAMP) {
+                // the driver's timestamp wraps at 32 bits
+                if ((uint32_t)ev->value < dev->last_ts)
+                    dev->ts_high += 1ull << 32;
+                dev->last_ts = ev->value;
+            } else if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+                send_frame(sock, dev, slot, now);
+            } else if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+                for (int k = 0; k < IMU_AXES; ++k) {
+                    struct input_absinfo info;
+                    if (ioctl(dev->fd, EVIOCGABS(ABS_X + k), &info) == 0)
+                        dev->value[k] = info.value;
+                }
+            }
+        }
+    }
+    return res < 0 && errno != EAGAIN ? -1 : 0;
+}
+
+struct dsu_client* find_client(struct sockaddr_in* addr, uint64_t now) {
+    struct dsu_client* free_client = NULL;
+
+    for (int i = 0; i < MAX_CLIENTS; ++i) {
+        struct dsu_client* c = &clients[i];
+        int active = 0;
+
+        if (c->addr.sin_addr.s_addr == addr->sin_addr.s_addr
+                && c->addr.sin_port == addr->sin_port)
+            return c;
+        for (int s = 0; s < DSU_SLOTS; ++s)
+            active |= c->until[s] > now;
+        if (!active && !free_client)
+            free_client = c;
+    }
+    if (free_client) {
+        memset(free_client, 0, sizeof(*free_client));
+        free_client->addr = *addr;
+    }
+    return free_client;
+}
+
+void handle_request(int sock, unsigned char* req, int size, struct sockaddr_in* addr) {
+    unsigned char resp[MAX_PACKET];
+    uint32_t type;
+    uint64_t now = now_ns();
+
+    if (!dsu_check(req, size, "DSUC"))
+        return;
+    type = get_u32(req + 16);
+
+    if (type == MSG_VERSION) {
+        memset(resp, 0, VERSION_SIZE);
+        dsu_header(resp, "DSUS", VERSION_SIZE, MSG_VERSION);
+        put_u16(resp + 20, DSU_VERSION);
+        dsu_finish(resp, VERSION_SIZE);
+        sendto(sock, resp, VERSION_SIZE, MSG_DONTWAIT, (struct sockaddr*)addr, sizeof(*addr));
+    } else if (type == MSG_PORTS && size >= 24) {
+        int count = (int)get_u32(req + 20);
+
+        for (int i = 0; i < count && i < DSU_SLOTS && 24 + i < size; ++i) {
+            int slot = req[24 + i];
+            if (slot >= DSU_SLOTS)
+                continue;
+            memset(resp, 0, PORTS_SIZE);
+            dsu_header(resp, "DSUS", PORTS_SIZE, MSG_PORTS);
+            put_slot_info(resp + 20, slot);
+            dsu_finish(resp, PORTS_SIZE);
+            sendto(sock, resp, PORTS_SIZE, MSG_DONTWAIT, (struct sockaddr*)addr, sizeof(*addr));
+        }
+    } else if (type == MSG_DATA && size >= DATA_REQUEST_SIZE) {
+        // flags 0 is every slot, bit 0 one slot, bit 1 one mac
+        int flags = req[20];
+        struct dsu_client* c = find_client(addr, now);
+
+        if (!c)
+            return;
+        for (int s = 0; s < DSU_SLOTS; ++s) {
+            unsigned char mac[6] = {0, 0, 0, 0, 0, s + 1};
+            if (flags == 0 || ((flags & 1) && req[21] == s)
+                    || ((flags & 2) && memcmp(req + 22, mac, 6) == 0))
+                c->until[s] = now + CLIENT_TIMEOUT_NS;
+        }
+    }
+}
+
+int open_socket(const char* bind_addr, int port, int server) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1) {
+        fprintf(stderr, "%s: not an ipv4 address\n", bind_addr);
+        close(sock);
+        return -1;
+    }
+    if (server ? bind(sock, (struct sockaddr*)&addr, sizeof(addr))
+            : connect(sock, (struct sockaddr*)&addr, sizeof(addr))) {
+        fprintf(stderr, "%s:%d: %s\n", bind_addr, port, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int serve(int sock) {
+    struct epoll_event ee = { .events = EPOLLIN }, events[DSU_SLOTS + 1];
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    uint64_t last_scan = 0;
+
+    ee.data.u32 = DSU_SLOTS;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ee);
+
+    while (!is_exit) {
+        int n;
+
+        if (now_ns() - last_scan >= RESCAN_MS * 1000000ull) {
+            int opened[DSU_SLOTS];
+
+            for (int s = 0; s < DSU_SLOTS; ++s)
+                opened[s] = slots[s].fd >= 0;
+            scan_devices();
+            for (int s = 0; s < DSU_SLOTS; ++s) {
+                if (opened[s] || slots[s].fd < 0)
+                    continue;
+                ee.data.u32 = s;
+                epoll_ctl(epfd, EPOLL_CTL_ADD, slots[s].fd, &ee);
+            }
+            last_scan = now_ns();
+        }
+
+        n = epoll_wait(epfd, events, DSU_SLOTS + 1, RESCAN_MS);
+        for (int i = 0; i < n; ++i) {
+            uint32_t s = events[i].data.u32;
+
+            if (s == DSU_SLOTS) {
+                unsigned char req[MAX_PACKET];
+                struct sockaddr_in addr;
+                socklen_t len = sizeof(addr);
+                ssize_t size;
+
+                while ((size = recvfrom(sock, req, sizeof(req), 0,
+                        (struct sockaddr*)&addr, &len)) > 0) {
+                    handle_request(sock, req, size, &addr);
+                    len = sizeof(addr);
+                }
+            } else if (slots[s].fd >= 0 && read_device(sock, s) < 0) {
+                close_slot(epfd, s);
+            }
+        }
+    }
+
+    for (int s = 0; s < DSU_SLOTS; ++s) {
+        struct dsu_device* dev = &slots[s];
+
+        if (dev->fd < 0)
+            continue;
+        printf("slot %d: %s, %llu frames, %llu packets sent", s, dev->name,
+            (unsigned long long)dev->frames, (unsigned long long)dev->sent);
+        if (dev->send_errors)
+            printf(", %llu send errors", (unsigned long long)dev->send_errors);
+        printf("\n");
+        close(dev->fd);
+    }
+    close(epfd);
+    return 0;
+}
+
+/*
+ * test client. asks for the version and the slots once, then keeps a
+ * subscription to every slot alive and prints once per second.
+ */
+struct client_slot {
+    int connected;
+    uint64_t packets, window, gaps, backwards;
+    uint32_t next_num;
+    uint64_t last_ts;
+    float motion[IMU_AXES];
+};
+
+int run_client(int sock) {
+    struct client_slot cs[DSU_SLOTS];
+    unsigned char req[DATA_REQUEST_SIZE], resp[MAX_PACKET];
+    uint64_t bad = 0, last_print = 0, last_request = 0, start = now_ns();
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ee = { .events = EPOLLIN };
+
+    memset(cs, 0, sizeof(cs));
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ee);
+
+    memset(req, 0, sizeof(req));
+    dsu_header(req, "DSUC", REQUEST_SIZE, MSG_VERSION);
+    dsu_finish(req, REQUEST_SIZE);
+    send(sock, req, REQUEST_SIZE, 0);
+
+    memset(req, 0, sizeof(req));
+    dsu_header(req, "DSUC", 24 + DSU_SLOTS, MSG_PORTS);
+    put_u32(req + 20, DSU_SLOTS);
+    for (int s = 0; s < DSU_SLOTS; ++s)
+        req[24 + s] = s;
+    dsu_finish(req, 24 + DSU_SLOTS);
+    send(sock, req, 24 + DSU_SLOTS, 0);
+
+    while (!is_exit) {
+        uint64_t now = now_ns();
+        ssize_t size;
+
+        if (now - last_request >= 1000000000ull) {
+            memset(req, 0, sizeof(req));
+            dsu_header(req, "DSUC", DATA_REQUEST_SIZE, MSG_DATA);
+            dsu_finish(req, DATA_REQUEST_SIZE);
+            send(sock, req, DATA_REQUEST_SIZE, 0);
+            last_request = now;
+        }
+        if (now - last_print >= 1000000000ull) {
+            double dt = (now - last_print) / 1e9;
+
+            for (int s = 0; s < DSU_SLOTS && last_print; ++s) {
+                struct client_slot* c = &cs[s];
+                if (!c->connected && !c->packets)
+                    continue;
+                printf("slot %d: %6.0f/s  accel %6.3f %6.3f %6.3f  gyro %8.2f %8.2f %8.2f"
+                    "  gaps %llu\n", s, c->window / dt,
+                    c->motion[0], c->motion[1], c->motion[2],
+                    c->motion[3], c->motion[4], c->motion[5],
+                    (unsigned long long)c->gaps);
+                c->window = 0;
+            }
+            last_print = now;
+        }
+
+        if (epoll_wait(epfd, &ee, 1, 100) <= 0)
+            continue;
+        while ((size = recv(sock, resp, sizeof(resp), 0)) > 0) {
+            uint32_t type;
+            int slot;
+
+            if (!dsu_check(resp, size, "DSUS")) {
+                ++bad;
+                continue;
+            }
+            type = get_u32(resp + 16);
+            if (type == MSG_VERSION && size >= VERSION_SIZE) {
+                printf("server %08x, protocol %d\n", get_u32(resp + 12),
+                    resp[20] | resp[21] << 8);
+                continue;
+            }
+            if ((type != MSG_PORTS && type != MSG_DATA) || size < PORTS_SIZE)
+                continue;
+            slot = resp[20];
+            if (slot >= DSU_SLOTS)
+                continue;
+            if (type == MSG_PORTS) {
+                cs[slot].connected = resp[21] == STATE_CONNECTED;
+                printf("slot %d: %s\n", slot, cs[slot].connected
+                    ? (resp[23] == CONNECTION_BT ? "connected, wireless" : "connected, usb")
+                    : "not connected");
+                continue;
+            }
+            if (size < DATA_SIZE)
+                continue;
+
+            struct client_slot* c = &cs[slot];
+            uint32_t num = get_u32(resp + DATA_PACKET_NUM);
+            uint64_t ts = get_u64(resp + DATA_TIMESTAMP);
+
+            if (c->packets && num != c->next_num)
+                ++c->gaps;
+            if (c->packets && ts < c->last_ts)
+                ++c->backwards;
+            c->next_num = num + 1;
+            c->last_ts = ts;
+            for (int i = 0; i < IMU_AXES; ++i)
+                c->motion[i] = get_float(resp + DATA_ACCEL + i * 4);
+            c->connected = 1;
+            ++c->packets;
+            ++c->window;
+        }
+    }
+
+    printf("\n%.1f s, %llu bad packets\n", (now_ns() - start) / 1e9, (unsigned long long)bad);
+    for (int s = 0; s < DSU_SLOTS; ++s) {
+        struct client_slot* c = &cs[s];
+        if (!c->packets)
+            continue;
+        printf("slot %d: %llu packets, %llu gaps, %llu timestamps going back\n", s,
+            (unsigned long long)c->packets, (unsigned long long)c->gaps,
+            (unsigned long long)c->backwards);
+    }
+    close(epfd);
+    return bad != 0;
+}
+
+int main(int argc, char** argv) {
+    const char* bind_addr = "127.0.0.1";
+    int port = DSU_PORT;
+    int client = 0;
+    int sock, ret;
+
+    while (1) {
+        int c = getopt_long(argc, argv, optstring, options, NULL);
+
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'b':
+                bind_addr = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'a':
+                if (parse_axis_map(optarg, &accel_map)) {
+                    fprintf(stderr, "bad accel map %s, want e.g. y+z-x+\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g':
+                if (parse_axis_map(optarg, &gyro_map)) {
+                    fprintf(stderr, "bad gyro map %s, want e.g. y-z-x+\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                gyro_sensitivity = atof(optarg);
+                break;
+            case 'c':
+                client = 1;
+                break;
+            default:
+                break;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    crc_init();
+    server_id = getpid() ^ (uint32_t)now_ns();
+    for (int s = 0; s < DSU_SLOTS; ++s)
+        slots[s].fd = -1;
+
+    signal(SIGINT, set_exit_flag);
+    signal(SIGTERM, set_exit_flag);
+
+    sock = open_socket(bind_addr, port, !client);
+    if (sock < 0)
+        return 1;
+    if (client) {
+        ret = run_client(sock);
+    } else {
+        printf("serving on %s:%d\n", bind_addr, port);
+        ret = serve(sock);
+    }
+    close(sock);
+    return ret;
+}
@@ -0,0 +1,654 @@
+/*
+ * end to end latency probe for hid-betop-t6.
+ *
+ * opens a T6's hidraw node together with the IMU and gamepad evdev nodes
+ * the driver created for it, each read on its own thread and stamped with
+ * CLOCK_MONOTONIC right after read() returns. every evdev frame is matched
+ * to the raw report it came from by content:
+ *
+ * - IMU frames by accel, which the driver passes through unchanged except
+ *   for the input core's fuzz filter, so within fuzz of the raw values.
+ *   the gyro carries the bias correction and isn't compared. with
+ *   imu_decimation above 1 or imu_smoothing on nothing would match, so it
+ *   refuses to run then.
+ * - gamepad frames that change buttons by the button state, mapped through
+ *   the device's keymap. axis only frames aren't matched, the axis tables
+ *   can be anything.
+ *
+ * frames are matched in order, raw reports passed over are missing frames,
+ * a frame equal to the report matched last is a duplicate.
+ *
+ * the driver runs before hid core hands the report to hidraw, so the evdev
+ * timestamp is the earliest point; delays are given from it to each
+ * reader, and between the two readers.
+ *
+ * works the same on a uhid device, e.g. one made by t6-uhid-bench.
+ */
+
+#include "hid-ids.h"
+
+#include <linux/hidraw.h>
+#include <linux/input.h>
+#include <getopt.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <glob.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define T6_RDESC_SIZE 211
+#define T6_BTN_COUNT 24
+#define QUEUE_SIZE 4096
+#define PENDING_MAX 256
+// a frame without a report this long after it won't get one
+#define MATCH_WINDOW_NS 200000000ull
+#define LAT_SAMPLES (1 << 20)
+
+enum { SRC_HIDRAW, SRC_IMU, SRC_GAMEPAD, SRC_COUNT };
+
+struct item {
+    uint64_t t_ns;
+    uint64_t ts_ns;
+    int size;
+    unsigned char data[64];
+    int32_t accel[3];
+    uint32_t btns;
+    int has_keys;
+};
+
+/*
+ * each reader thread fills its own queue, the main thread drains them
+ * every few ms under the lock and does all the matching.
+ */
+struct queue {
+    pthread_mutex_t lock;
+    struct item items[QUEUE_SIZE];
+    int head, count;
+    uint64_t overflow;
+};
+
+struct source {
+    int fd;
+    char path[PATH_MAX];
+    struct queue q;
+    pthread_t thread;
+};
+
+struct lat {
+    int64_t v[LAT_SAMPLES];
+    uint64_t count;
+};
+
+struct source sources[SRC_COUNT];
+const char* source_names[SRC_COUNT] = { "hidraw", "imu", "gamepad" };
+
+uint16_t keymap[T6_BTN_COUNT] = {
+    BTN_DPAD_UP, BTN_DPAD_DOWN, BTN_DPAD_LEFT, BTN_DPAD_RIGHT,
+    BTN_START, BTN_SELECT, BTN_THUMBL, BTN_THUMBR,
+    BTN_TL, BTN_TR, KEY_RESERVED, KEY_RESERVED,
+    BTN_A, BTN_B, BTN_X, BTN_Y,
+    BTN_BASE, BTN_BASE2, BTN_BASE3, BTN_BASE4,
+};
+int accel_fuzz = 10;
+
+// raw reports waiting for their imu frame, and the ones that changed buttons
+struct item imu_pending[PENDING_MAX], btn_pending[PENDING_MAX];
+int imu_npending, btn_npending;
+// frames waiting for their report
+struct item frame_pending[SRC_COUNT][PENDING_MAX];
+int frame_npending[SRC_COUNT];
+struct item last_imu_match;
+int have_imu_match;
+uint32_t last_raw_btns;
+
+struct counters {
+    uint64_t reports, frames, matched, missing, dup, unmatched;
+} imu_count, btn_count;
+struct lat lat_evdev_hidraw, lat_ts_evdev, lat_ts_hidraw;
+
+atomic_int is_exit = 0;
+// written once at exit, wakes the readers out of poll()
+int wake_pipe[2] = { -1, -1 };
+
+char optstring[] = "p:t:";
+struct option options[] = {
+    {"hidraw", required_argument, 0, 'p'},
+    {"time", required_argument, 0, 't'},
+    {0, 0, 0, 0},
+};
+
+void set_exit_flag(int sig) {
+    is_exit = 1;
+}
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 0 once the readers should stop
+int wait_readable(int fd) {
+    struct pollfd pfd[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = wake_pipe[0], .events = POLLIN },
+    };
+
+    while (poll(pfd, 2, -1) < 0)
+        if (errno != EINTR)
+            return 0;
+    return !pfd[1].revents;
+}
+
+void queue_push(struct queue* q, struct item* it) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == QUEUE_SIZE)
+        ++q->overflow;
+    else
+        q->items[(q->head + q->count++) % QUEUE_SIZE] = *it;
+    pthread_mutex_unlock(&q->lock);
+}
+
+void* hidraw_thread(void* arg) {
+    struct source* src = arg;
+    struct item it;
+    ssize_t size;
+
+    memset(&it, 0, sizeof(it));
+    while (!is_exit && wait_readable(src->fd)) {
+        size = read(src->fd, it.data, sizeof(it.data));
+        it.t_ns = now_ns();
+        if (size <= 0) {
+            if (size < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        it.size = size;
+        queue_push(&src->q, &it);
+    }
+    is_exit = 1;
+    return NULL;
+}
+
+// keeps the device state, a frame is the whole state at SYN_REPORT
+void* evdev_thread(void* arg) {
+    struct source* src = arg;
+    struct input_event evs[64];
+    struct item it;
+    ssize_t size;
+    uint64_t t;
+
+    memset(&it, 0, sizeof(it));
+    while (!is_exit && wait_readable(src->fd)) {
+        size = read(src->fd, evs, sizeof(evs));
+        t = now_ns();
+        if (size <= 0) {
+            if (size < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < size / sizeof(evs[0]); ++i) {
+            struct input_event* ev = &evs[i];
+
+            if (ev->type == EV_ABS && ev->code <= ABS_Z) {
+                it.accel[ev->code] = ev->value;
+            } else if (ev->type == EV_KEY) {
+                for (int b = 0; b < T6_BTN_COUNT; ++b) {
+                    if (keymap[b] != ev->code)
+                        continue;
+                    if (ev->value)
+                        it.btns |= 1u << b;
+                    else
+                        it.btns &= ~(1u << b);
+                }
+                it.has_keys = 1;
+            } else if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+                it.t_ns = t;
+                it.ts_ns = ev->input_event_sec * 1000000000ull + ev->input_event_usec * 1000ull;
+                queue_push(&src->q, &it);
+                it.has_keys = 0;
+            }
+        }
+    }
+    is_exit = 1;
+    return NULL;
+}
+
+void lat_add(struct lat* l, int64_t v) {
+    l->v[l->count++ % LAT_SAMPLES] = v;
+}
+
+int cmp_s64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+void lat_print(const char* name, struct lat* l) {
+    static int64_t sorted[LAT_SAMPLES];
+    uint64_t n = l->count < LAT_SAMPLES ? l->count : LAT_SAMPLES;
+
+    if (!n) {
+        printf("%-16s no samples\n", name);
+        return;
+    }
+    memcpy(sorted, l->v, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), cmp_s64);
+    printf("%-16s min %8.1f  p50 %8.1f  p99 %8.1f  max %8.1f us\n", name,
+        sorted[0] / 1e3, sorted[n / 2] / 1e3, sorted[n * 99 / 100] / 1e3,
+        sorted[n - 1] / 1e3);
+}
+
+// raw report fields, from the report layouts in hid-betop-t6.c
+int report_imu(const struct item* r, int32_t* accel) {
+    int off = r->data[0] == 4 ? 2 : r->data[0] == 5 ? 23 : -1;
+
+    if (off < 0 || r->size < (r->data[0] == 4 ? 32 : 64))
+        return 0;
+    for (int i = 0; i < 3; ++i)
+        accel[i] = (int16_t)(r->data[off + i * 2] | r->data[off + i * 2 + 1] << 8);
+    return 1;
+}
+
+int report_btns(const struct item* r, uint32_t* btns) {
+    uint32_t raw;
+
+    if (r->data[0] != 5 || r->size < 64)
+        return 0;
+    raw = r->data[8] | r->data[9] << 8 | r->data[10] << 16;
+    *btns = 0;
+    for (int b = 0; b < T6_BTN_COUNT; ++b)
+        if ((raw & 1u << b) && keymap[b] != KEY_RESERVED)
+            *btns |= 1u << b;
+    return 1;
+}
+
+int imu_matches(const struct item* r, const struct item* f) {
+    int32_t accel[3];
+
+    if (!report_imu(r, accel))
+        return 0;
+    for (int i = 0; i < 3; ++i)
+        if (abs(accel[i] - f->accel[i]) > accel_fuzz)
+            return 0;
+    return 1;
+}
+
+void drop(struct item* items, int* count, int n) {
+    memmove(items, items + n, (*count - n) * sizeof(items[0]));
+    *count -= n;
+}
+
+void append(struct item* items, int* count, const struct item* it, uint64_t* overflow) {
+    if (*count == PENDING_MAX) {
+        drop(items, count, 1);
+        ++*overflow;
+    }
+    items[(*count)++] = *it;
+}
+
+void record_match(const struct item* r, const struct item* f) {
+    lat_add(&lat_evdev_hidraw, (int64_t)(f->t_ns - r->t_ns));
+    lat_add(&lat_ts_evdev, (int64_t)(f->t_ns - f->ts_ns));
+    lat_add(&lat_ts_hidraw, (int64_t)(r->t_ns - f->ts_ns));
+}
+
+/*
+ * every report with an imu block gives one frame, in order.
+ * reports passed over by a match never got theirs.
+ */
+void match_imu(uint64_t now) {
+    struct item* frames = frame_pending[SRC_IMU];
+    int* nframes = &frame_npending[SRC_IMU];
+
+    while (*nframes) {
+        struct item* f = &frames[0];
+        int found = -1;
+
+        for (int i = 0; i < imu_npending && found < 0; ++i)
+            if (imu_matches(&imu_pending[i], f))
+                found = i;
+
+        if (found >= 0) {
+            imu_count.missing += found;
+            record_match(&imu_pending[found], f);
+            last_imu_match = imu_pending[found];
+            have_imu_match = 1;
+            ++imu_count.matched;
+            drop(imu_pending, &imu_npending, found + 1);
+        } else if (now - f->t_ns > MATCH_WINDOW_NS) {
+            if (have_imu_match && imu_matches(&last_imu_match, f))
+                ++imu_count.dup;
+            else
+                ++imu_count.unmatched;
+        } else {
+            break;
+        }
+        drop(frames, nframes, 1);
+    }
+
+    while (imu_npending && now - imu_pending[0].t_ns > MATCH_WINDOW_NS) {
+        ++imu_count.missing;
+        drop(imu_pending, &imu_npending, 1);
+    }
+}
+
+// only reports that change the mapped buttons give a frame with keys
+void match_btns(uint64_t now) {
+    struct item* frames = frame_pending[SRC_GAMEPAD];
+    int* nframes = &frame_npending[SRC_GAMEPAD];
+
+    while (*nframes) {
+        struct item* f = &frames[0];
+        int found = -1;
+
+        for (int i = 0; f->has_keys && i < btn_npending && found < 0; ++i)
+            if (btn_pending[i].btns == f->btns)
+                found = i;
+
+        if (!f->has_keys) {
+            // axis only
+        } else if (found >= 0) {
+            btn_count.missing += found;
+            record_match(&btn_pending[found], f);
+            ++btn_count.matched;
+            drop(btn_pending, &btn_npending, found + 1);
+        } else if (now - f->t_ns > MATCH_WINDOW_NS) {
+            ++btn_count.unmatched;
+        } else {
+            break;
+        }
+        drop(frames, nframes, 1);
+    }
+
+    while (btn_npending && now - btn_pending[0].t_ns > MATCH_WINDOW_NS) {
+        ++btn_count.missing;
+        drop(btn_pending, &btn_npending, 1);
+    }
+}
+
+void drain(uint64_t* overflow) {
+    for (int s = 0; s < SRC_COUNT; ++s) {
+        struct queue* q = &sources[s].q;
+
+        if (sources[s].fd < 0)
+            continue;
+        pthread_mutex_lock(&q->lock);
+        for (; q->count; --q->count, q->head = (q->head + 1) % QUEUE_SIZE) {
+            struct item* it = &q->items[q->head];
+            int32_t accel[3];
+
+            if (s != SRC_HIDRAW) {
+                if (s == SRC_IMU)
+                    ++imu_count.frames;
+                else if (it->has_keys)
+                    ++btn_count.frames;
+                append(frame_pending[s], &frame_npending[s], it, overflow);
+                continue;
+            }
+            if (report_imu(it, accel)) {
+                ++imu_count.reports;
+                append(imu_pending, &imu_npending, it, overflow);
+            }
+            if (report_btns(it, &it->btns) && it->btns != last_raw_btns) {
+                ++btn_count.reports;
+                last_raw_btns = it->btns;
+                append(btn_pending, &btn_npending, it, overflow);
+            }
+        }
+        *overflow += q->overflow;
+        q->overflow = 0;
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+int read_sysfs(const char* dir, const char* attr, char* buf, int size) {
+    char path[PATH_MAX + 64];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    buf[0] = 0;
+    fgets(buf, size, f);
+    fclose(f);
+    buf[strcspn(buf, "\n")] = 0;
+    return 0;
+}
+
+int is_t6_hidraw(int fd) {
+    struct hidraw_devinfo info;
+    int size;
+
+    if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0 || (uint16_t)info.vendor != USB_VENDOR_ID_BETOP)
+        return 0;
+    if ((uint16_t)info.product != USB_DEVICE_ID_BETOP_T6_USB
+            && (uint16_t)info.product != USB_DEVICE_ID_BETOP_T6_ADAPTER
+            && (uint16_t)info.product != USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO
+            && (uint16_t)info.product != USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO)
+        return 0;
+    // the interface the driver takes, like btp_t6_verify_device
+    return ioctl(fd, HIDIOCGRDESCSIZE, &size) == 0 && size == T6_RDESC_SIZE;
+}
+
+int open_hidraw(const char* path) {
+    glob_t g;
+    int fd = -1;
+
+    if (path) {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            perror(path);
+        else
+            snprintf(sources[SRC_HIDRAW].path, PATH_MAX, "%s", path);
+        return fd;
+    }
+    if (glob("/dev/hidraw*", 0, NULL, &g))
+        return -1;
+    for (size_t i = 0; i < g.gl_pathc && fd < 0; ++i) {
+        fd = open(g.gl_pathv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        if (!is_t6_hidraw(fd)) {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        snprintf(sources[SRC_HIDRAW].path, PATH_MAX, "%s", g.gl_pathv[i]);
+    }
+    globfree(&g);
+    return fd;
+}
+
+// the driver's input devices are children of the hid device
+void open_evdevs(const char* hid_dir) {
+    glob_t g;
+    char path[PATH_MAX], real[PATH_MAX], name[256];
+    int clk = CLOCK_MONOTONIC, num, src;
+
+    if (glob("/sys/class/input/event*", 0, NULL, &g))
+        return;
+    for (size_t i = 0; i < g.gl_pathc; ++i) {
+        snprintf(path, sizeof(path), "%s/device/device", g.gl_pathv[i]);
+        if (!realpath(path, real) || strcmp(real, hid_dir))
+            continue;
+        snprintf(path, sizeof(path), "%s/device", g.gl_pathv[i]);
+        if (read_sysfs(path, "name", name, sizeof(name)))
+            continue;
+        if (strstr(name, " Orientation"))
+            continue;
+        src = strstr(name, " IMU") ? SRC_IMU : SRC_GAMEPAD;
+        if (sources[src].fd >= 0 || sscanf(g.gl_pathv[i], "/sys/class/input/event%d", &num) != 1)
+            continue;
+
+        snprintf(sources[src].path, PATH_MAX, "/dev/input/event%d", num);
+        sources[src].fd = open(sources[src].path, O_RDONLY | O_CLOEXEC);
+        if (sources[src].fd < 0) {
+            perror(sources[src].path);
+            continue;
+        }
+        ioctl(sources[src].fd, EVIOCSCLOCKID, &clk);
+        if (src == SRC_IMU) {
+            struct input_absinfo info;
+            if (ioctl(sources[src].fd, EVIOCGABS(ABS_X), &info) == 0)
+                accel_fuzz = info.fuzz;
+        }
+    }
+    globfree(&g);
+}
+
+void read_keymap(const char* hid_dir) {
+    char buf[512], *p = buf, *end;
+
+    if (read_sysfs(hid_dir, "keymap", buf, sizeof(buf)))
+        return;
+    for (int i = 0; i < T6_BTN_COUNT; ++i, p = end) {
+        long code = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        keymap[i] = code;
+    }
+}
+
+void print_counters(const char* name, struct counters* c) {
+    printf("%-8s %8llu reports %8llu frames %8llu matched %6llu missing %6llu duplicated"
+        " %6llu unmatched\n", name,
+        (unsigned long long)c->reports, (unsigned long long)c->frames,
+        (unsigned long long)c->matched, (unsigned long long)c->missing,
+        (unsigned long long)c->dup, (unsigned long long)c->unmatched);
+}
+
+int main(int argc, char** argv) {
+    const char* hidraw_path = NULL;
+    double duration = 0;
+    char link[PATH_MAX], hid_dir[PATH_MAX], buf[64];
+    uint64_t start, last_print, overflow = 0;
+    void* (*threads[SRC_COUNT])(void*) = { hidraw_thread, evdev_thread, evdev_thread };
+
+    while (1) {
+        int c = getopt_long(argc, argv, optstring, options, NULL);
+
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'p':
+                hidraw_path = optarg;
+                break;
+            case 't':
+                duration = atof(optarg);
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (int s = 0; s < SRC_COUNT; ++s) {
+        sources[s].fd = -1;
+        pthread_mutex_init(&sources[s].q.lock, NULL);
+    }
+
+    sources[SRC_HIDRAW].fd = open_hidraw(hidraw_path);
+    if (sources[SRC_HIDRAW].fd < 0) {
+        fprintf(stderr, "no T6 hidraw node found, use --hidraw\n");
+        return 1;
+    }
+    snprintf(link, sizeof(link), "/sys/class/hidraw/%s/device",
+        strrchr(sources[SRC_HIDRAW].path, '/') + 1);
+    if (!realpath(link, hid_dir)) {
+        perror(link);
+        return 1;
+    }
+    open_evdevs(hid_dir);
+    if (sources[SRC_IMU].fd < 0) {
+        fprintf(stderr, "%s: no IMU input device, is hid-betop-t6 bound?\n", hid_dir);
+        return 1;
+    }
+    read_keymap(hid_dir);
+    // averaged or smoothed accel never equals the raw values, nothing would match
+    if (!read_sysfs(hid_dir, "imu_decimation", buf, sizeof(buf)) && atoi(buf) > 1) {
+        fprintf(stderr, "imu_decimation is %s, IMU frames can't be matched to reports, "
+            "turn it off with: echo 1 > %s/imu_decimation\n", buf, hid_dir);
+        return 1;
+    }
+    if (!read_sysfs(hid_dir, "imu_smoothing", buf, sizeof(buf)) && atoi(buf) != 0) {
+        fprintf(stderr, "imu_smoothing is %s, IMU frames can't be matched to reports, "
+            "turn it off with: echo 0 0 > %s/imu_smoothing\n", buf, hid_dir);
+        return 1;
+    }
+
+    for (int s = 0; s < SRC_COUNT; ++s)
+        printf("%-8s %s\n", source_names[s], sources[s].fd >= 0 ? sources[s].path : "-");
+    printf("\n");
+
+    signal(SIGINT, set_exit_flag);
+    signal(SIGTERM, set_exit_flag);
+    if (pipe(wake_pipe) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    for (int s = 0; s < SRC_COUNT; ++s)
+        if (sources[s].fd >= 0)
+            pthread_create(&sources[s].thread, NULL, threads[s], &sources[s]);
+
+    start = last_print = now_ns();
+    while (!is_exit) {
+        uint64_t now;
+
+        usleep(5000);
+        now = now_ns();
+        drain(&overflow);
+        match_imu(now);
+        match_btns(now);
+        if (now - last_print >= 1000000000ull) {
+            printf("imu %llu/%llu matched, %llu missing   buttons %llu/%llu matched\n",
+                (unsigned long long)imu_count.matched, (unsigned long long)imu_count.reports,
+                (unsigned long long)imu_count.missing,
+                (unsigned long long)btn_count.matched, (unsigned long long)btn_count.reports);
+            last_print = now;
+        }
+        if (duration > 0 && now - start >= duration * 1e9)
+            break;
+    }
+
+    // the readers are done before the queues are read for the last time
+    is_exit = 1;
+    if (write(wake_pipe[1], "", 1) < 0)
+        perror("wake readers");
+    for (int s = 0; s < SRC_COUNT; ++s) {
+        if (sources[s].fd < 0)
+            continue;
+        pthread_join(sources[s].thread, NULL);
+        close(sources[s].fd);
+    }
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+
+    // whatever is still waiting won't get a partner anymore
+    drain(&overflow);
+    match_imu(UINT64_MAX);
+    match_btns(UINT64_MAX);
+
+    printf("\n%.1f s\n", (now_ns() - start) / 1e9);
+    print_counters("imu", &imu_count);
+    if (sources[SRC_GAMEPAD].fd >= 0)
+        print_counters("buttons", &btn_count);
+    if (overflow)
+        printf("%llu items dropped on full queues\n", (unsigned long long)overflow);
+    printf("\n");
+    lat_print("evdev - hidraw", &lat_evdev_hidraw);
+    lat_print("ts -> evdev", &lat_ts_evdev);
+    lat_print("ts -> hidraw", &lat_ts_hidraw);
+    return 0;
+}
@@ -0,0 +1,883 @@
+/*
+ * replay / throughput benchmark for hid-betop-t6 without hardware.
+ *
+ * creates N virtual T6 through /dev/uhid, feeds them synthetic or recorded
+ * report 4/5 streams at a fixed rate, reads back the evdev nodes the driver
+ * creates and reports reports/sec, cpu per controller and report-to-evdev
+ * latency percentiles.
+ *
+ * the kernel side of a uhid write (hid core, the driver, evdev) runs in the
+ * context of the writing thread, so the cpu time of a writer thread is what
+ * the driver costs for that controller.
+ *
+ * --verify instead feeds a fixed list of reports to one device and checks
+ * the evdev state after each against the values the driver should produce,
+ * then times a burst of reports for the per report cost.
+ */
+
+#include "hid-ids.h"
+
+#include <linux/uhid.h>
+#include <linux/input.h>
+#include <getopt.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define MAX_DEVICES 64
+#define SEND_RING_SIZE 4096
+#define REPORT4_SIZE 32
+#define REPORT5_SIZE 64
+
+/*
+ * synthetic, not the controller's descriptor, which isn't dumped anywhere.
+ * it declares input reports 4 and 5 with the sizes hid-betop-t6.c parses
+ * and is padded with vendor feature reports to the 211 bytes
+ * btp_t6_verify_device looks for. no output reports.
+ */
+static const unsigned char t6_rdesc[] = {
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x01,
+    0x85, 0x04, 0x06, 0x00, 0xff,
+    0x09, 0x01, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+    0x09, 0x20, 0x16, 0x00, 0x80, 0x26, 0xff, 0x7f, 0x75, 0x10, 0x95, 0x06, 0x81, 0x02,
+    0x09, 0x21, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x12, 0x81, 0x02,
+    0x85, 0x05, 0x09, 0x01, 0x95, 0x01, 0x81, 0x02,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x33, 0x09, 0x34, 0x95, 0x04, 0x81, 0x02,
+    0x09, 0x32, 0x09, 0x35, 0x95, 0x02, 0x81, 0x02,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x18, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x18, 0x81, 0x02,
+    0x06, 0x00, 0xff, 0x09, 0x22, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x0c, 0x81, 0x02,
+    0x09, 0x20, 0x16, 0x00, 0x80, 0x26, 0xff, 0x7f, 0x75, 0x10, 0x95, 0x06, 0x81, 0x02,
+    0x09, 0x23, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x1d, 0x81, 0x02,
+    0xc0,
+    0x06, 0x00, 0xff, 0x09, 0x02, 0xa1, 0x01,
+    0x85, 0x06, 0x09, 0x26, 0x95, 0x3f, 0xb1, 0x02,
+    0x85, 0x07, 0x09, 0x27, 0x95, 0x3f, 0xb1, 0x02,
+    0x85, 0x08, 0x09, 0x28, 0x95, 0x3f, 0xb1, 0x02,
+    0x85, 0x09, 0x09, 0x29, 0x95, 0x3f, 0xb1, 0x02,
+    0x85, 0x0a, 0x09, 0x2a, 0x95, 0x3f, 0xb1, 0x02,
+    0x85, 0x0b, 0x09, 0x2b, 0x09, 0x2c, 0x09, 0x2d, 0x09, 0x2e, 0x95, 0x3f, 0xb1, 0x02,
+    0x85, 0x0c, 0x09, 0x2f, 0x95, 0x3f, 0xb1, 0x02,
+    0xc0,
+};
+_Static_assert(sizeof(t6_rdesc) == 211, "btp_t6_verify_device wants 211 bytes");
+
+struct product {
+    const char* name;
+    unsigned short id;
+    int wired;
+};
+
+struct product products[] = {
+    {"usb", USB_DEVICE_ID_BETOP_T6_USB, 1},
+    {"adapter", USB_DEVICE_ID_BETOP_T6_ADAPTER, 0},
+    {"usb-audio", USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO, 1},
+    {"adapter-audio", USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO, 0},
+};
+
+struct recorded {
+    unsigned char (*reports)[REPORT5_SIZE];
+    int* sizes;
+    size_t count;
+};
+
+struct bench_dev {
+    int index;
+    int uhid_fd;
+    int imu_fd;
+    int ctlr_fd;
+    char uniq[64];
+    char hid_path[PATH_MAX];
+    pthread_t writer;
+
+    // send times, written by the writer, consumed by the reader
+    uint64_t send_ns[SEND_RING_SIZE];
+    atomic_uint_fast64_t send_head;
+    uint64_t send_tail;
+
+    uint64_t sent;
+    uint64_t write_errors;
+    uint64_t imu_frames;
+    uint64_t ctlr_frames;
+    uint64_t outputs;
+    double cpu_s;
+
+    uint32_t* lat_kernel;
+    uint32_t* lat_user;
+    size_t nlat, cap;
+};
+
+char optstring[] = "n:r:t:p:i:v";
+struct option options[] = {
+    {"devices", required_argument, 0, 'n'},
+    {"rate", required_argument, 0, 'r'},
+    {"time", required_argument, 0, 't'},
+    {"product", required_argument, 0, 'p'},
+    {"input", required_argument, 0, 'i'},
+    {"verify", no_argument, 0, 'v'},
+    {0, 0, 0, 0}
+};
+
+struct bench_dev devs[MAX_DEVICES];
+int ndevs = 1;
+double rate = 250;
+double duration = 10;
+struct product* product = &products[0];
+struct recorded recorded;
+atomic_int is_exit = 0;
+
+uint64_t now_ns(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void set_exit_flag(int sig) {
+    is_exit = 1;
+}
+
+/*
+ * one report per line, hex bytes separated by spaces,
+ * that's what hidrawmon prints with -f hex.
+ */
+int load_recorded(const char* path) {
+    char line[1024];
+    size_t cap = 0;
+    FILE* f = fopen(path, "r");
+
+    if (!f) {
+        perror("Unable to open recording");
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char* p = line;
+        char* end;
+        int size = 0;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (recorded.count == cap) {
+            size_t new_cap = cap ? cap * 2 : 1024;
+            void* reports = realloc(recorded.reports, new_cap * sizeof(*recorded.reports));
+            void* sizes;
+
+            if (reports)
+                recorded.reports = reports;
+            sizes = realloc(recorded.sizes, new_cap * sizeof(*recorded.sizes));
+            if (sizes)
+                recorded.sizes = sizes;
+            if (!reports || !sizes) {
+                perror("Unable to load recording");
+                fclose(f);
+                return -1;
+            }
+            cap = new_cap;
+        }
+        while (size < REPORT5_SIZE) {
+            unsigned long v = strtoul(p, &end, 16);
+            if (end == p)
+                break;
+            recorded.reports[recorded.count][size++] = v;
+            p = end;
+        }
+        if (size == 0 || (recorded.reports[recorded.count][0] != 4 &&
+                recorded.reports[recorded.count][0] != 5))
+            continue;
+        recorded.sizes[recorded.count++] = size;
+    }
+    fclose(f);
+    if (!recorded.count) {
+        fprintf(stderr, "%s: no report 4/5 found\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * synthetic stream, every axis keeps moving so the fuzz in the driver
+ * never swallows a frame.
+ */
+int make_report(unsigned char* buf, uint64_t seq, int dev) {
+    int16_t imu[6];
+    int i, tri = (int)((seq * 7 + dev * 131) % 2000) - 1000;
+
+    imu[0] = tri;
+    imu[1] = -tri / 2;
+    imu[2] = 4096 + tri / 4;
+    imu[3] = tri * 3;
+    imu[4] = -tri * 2;
+    imu[5] = tri;
+
+    if (!product->wired) {
+        memset(buf, 0, REPORT4_SIZE);
+        buf[0] = 4;
+        memcpy(buf + 2, imu, sizeof(imu));
+        return REPORT4_SIZE;
+    }
+
+    memset(buf, 0, REPORT5_SIZE);
+    buf[0] = 5;
+    for (i = 0; i < 4; ++i)
+        buf[2 + i] = 0x80 + (tri >> 3) * (i & 1 ? -1 : 1);
+    buf[6] = (seq * 3) & 0xff;
+    buf[7] = (seq * 5) & 0xff;
+    buf[10] = (seq >> 6) & 0x0f;
+    memcpy(buf + 23, imu, sizeof(imu));
+    return REPORT5_SIZE;
+}
+
+int uhid_write(int fd, struct uhid_event* ev, size_t size) {
+    ssize_t ret = write(fd, ev, size);
+    if (ret < 0)
+        return -errno;
+    return ret == size ? 0 : -EFAULT;
+}
+
+int create_device(struct bench_dev* dev) {
+    struct uhid_event ev;
+
+    dev->uhid_fd = open("/dev/uhid", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (dev->uhid_fd < 0) {
+        perror("Unable to open /dev/uhid");
+        return -1;
+    }
+    snprintf(dev->uniq, sizeof(dev->uniq), "t6-bench-%d-%d", getpid(), dev->index);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char*)ev.u.create2.name, sizeof(ev.u.create2.name),
+        "Betop T6 uhid bench %d", dev->index);
+    strcpy((char*)ev.u.create2.uniq, dev->uniq);
+    ev.u.create2.rd_size = sizeof(t6_rdesc);
+    ev.u.create2.bus = BUS_USB;
+    ev.u.create2.vendor = USB_VENDOR_ID_BETOP;
+    ev.u.create2.product = product->id;
+    memcpy(ev.u.create2.rd_data, t6_rdesc, sizeof(t6_rdesc));
+
+    if (uhid_write(dev->uhid_fd, &ev, sizeof(ev)) < 0) {
+        perror("UHID_CREATE2");
+        return -1;
+    }
+    return 0;
+}
+
+void destroy_device(struct bench_dev* dev) {
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    uhid_write(dev->uhid_fd, &ev, sizeof(ev));
+    close(dev->uhid_fd);
+}
+
+/*
+ * the driver copies hdev->uniq to its input devices,
+ * so our own uniq finds the evdev nodes it made.
+ */
+int find_evdev(struct bench_dev* dev) {
+    glob_t g;
+    char path[512], buf[256];
+    size_t i;
+    FILE* f;
+
+    if (glob("/sys/class/input/event*/device/uniq", 0, NULL, &g))
+        return 0;
+    for (i = 0; i < g.gl_pathc; ++i) {
+        int fd, num, is_imu, clk = CLOCK_MONOTONIC;
+
+        f = fopen(g.gl_pathv[i], "r");
+        if (!f)
+            continue;
+        buf[0] = 0;
+        fgets(buf, sizeof(buf), f);
+        fclose(f);
+        buf[strcspn(buf, "\n")] = 0;
+        if (strcmp(buf, dev->uniq))
+            continue;
+
+        snprintf(path, sizeof(path), "%s", g.gl_pathv[i]);
+        strcpy(strrchr(path, '/'), "/name");
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        buf[0] = 0;
+        fgets(buf, sizeof(buf), f);
+        fclose(f);
+        buf[strcspn(buf, "\n")] = 0;
+        is_imu = strlen(buf) > 4 && strcmp(buf + strlen(buf) - 4, " IMU") == 0;
+        if (!is_imu && strstr(buf, " IMU"))
+            continue;
+        if ((is_imu && dev->imu_fd >= 0) || (!is_imu && dev->ctlr_fd >= 0))
+            continue;
+
+        if (sscanf(g.gl_pathv[i], "/sys/class/input/event%d/", &num) != 1)
+            continue;
+        snprintf(path, sizeof(path), "/dev/input/event%d", num);
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            perror(path);
+            continue;
+        }
+        ioctl(fd, EVIOCSCLOCKID, &clk);
+        snprintf(path, sizeof(path), "/sys/class/input/event%d/device/device", num);
+        if (!realpath(path, dev->hid_path))
+            dev->hid_path[0] = 0;
+        if (is_imu)
+            dev->imu_fd = fd;
+        else
+            dev->ctlr_fd = fd;
+    }
+    globfree(&g);
+    return dev->imu_fd >= 0 && (!product->wired || dev->ctlr_fd >= 0);
+}
+
+void* writer_thread(void* arg) {
+    struct bench_dev* dev = arg;
+    struct uhid_event ev;
+    struct timespec next, cpu;
+    uint64_t period_ns = 1000000000.0 / rate;
+    uint64_t end = now_ns(CLOCK_MONOTONIC) + duration * 1e9;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!is_exit) {
+        uint64_t head, t;
+        int size;
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            ++next.tv_sec;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        if (recorded.count) {
+            size_t i = dev->sent % recorded.count;
+            size = recorded.sizes[i];
+            memcpy(ev.u.input2.data, recorded.reports[i], size);
+        } else {
+            size = make_report(ev.u.input2.data, dev->sent, dev->index);
+        }
+        ev.u.input2.size = size;
+
+        t = now_ns(CLOCK_MONOTONIC);
+        if (t >= end)
+            break;
+        head = atomic_load_explicit(&dev->send_head, memory_order_relaxed);
+        dev->send_ns[head % SEND_RING_SIZE] = t;
+        atomic_store_explicit(&dev->send_head, head + 1, memory_order_release);
+
+        if (uhid_write(dev->uhid_fd, &ev,
+                offsetof(struct uhid_event, u.input2.data) + size) < 0)
+            ++dev->write_errors;
+        ++dev->sent;
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    dev->cpu_s = cpu.tv_sec + cpu.tv_nsec / 1e9;
+    return NULL;
+}
+
+/*
+ * a frame belongs to the newest report sent before the frame's kernel
+ * timestamp, this also holds when the driver decimates or drops.
+ */
+void imu_frame(struct bench_dev* dev, uint64_t ev_ns, uint64_t read_ns) {
+    uint64_t head = atomic_load_explicit(&dev->send_head, memory_order_acquire);
+    uint64_t send = 0;
+
+    while (dev->send_tail != head &&
+            dev->send_ns[dev->send_tail % SEND_RING_SIZE] <= ev_ns) {
+        send = dev->send_ns[dev->send_tail % SEND_RING_SIZE];
+        ++dev->send_tail;
+    }
+    ++dev->imu_frames;
+    if (!send || dev->nlat == dev->cap)
+        return;
+    dev->lat_kernel[dev->nlat] = ev_ns - send;
+    dev->lat_user[dev->nlat] = read_ns - send;
+    ++dev->nlat;
+}
+
+void drain_evdev(struct bench_dev* dev, int fd) {
+    struct input_event evs[64];
+    ssize_t res;
+    int i;
+
+    while ((res = read(fd, evs, sizeof(evs))) > 0) {
+        uint64_t read_ns = now_ns(CLOCK_MONOTONIC);
+        for (i = 0; i < res / sizeof(evs[0]); ++i) {
+            uint64_t ev_ns;
+            if (evs[i].type != EV_SYN || evs[i].code != SYN_REPORT)
+                continue;
+            ev_ns = evs[i].input_event_sec * 1000000000ull + evs[i].input_event_usec * 1000ull;
+            if (fd == dev->imu_fd)
+                imu_frame(dev, ev_ns, read_ns);
+            else
+                ++dev->ctlr_frames;
+        }
+    }
+}
+
+void drain_uhid(struct bench_dev* dev) {
+    struct uhid_event ev;
+
+    while (read(dev->uhid_fd, &ev, sizeof(ev)) > 0) {
+        if (ev.type == UHID_OUTPUT)
+            ++dev->outputs;
+    }
+}
+
+/*
+ * golden reports. id 0 is the product's own input report, 5 when wired,
+ * 4 on the adapter, which only carries the imu. expected values are what
+ * the driver makes of them with its default keymap and axis calibration.
+ * imu values either repeat or move by more than twice the fuzz, the input
+ * core would smooth them otherwise.
+ * id -1 is report 5 on the adapter, declared in the descriptor so hid core
+ * passes it on, but not one the driver parses there. hid core never hands
+ * undeclared ids to the driver, so wired products have nothing to send
+ * and skip it.
+ */
+struct golden {
+    const char* name;
+    int id;
+    int size;
+    unsigned char sticks[4];
+    unsigned char triggers[2];
+    uint32_t buttons;
+    int16_t imu[6];
+    int dropped;
+    int abs[6];
+    int keys[8];
+    int imu_abs[6];
+};
+
+const int golden_abs[] = { ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_Z, ABS_RZ };
+const int golden_imu_abs[] = { ABS_X, ABS_Y, ABS_Z, ABS_RX, ABS_RY, ABS_RZ };
+
+struct golden goldens[] = {
+    {
+        "neutral", 0, 0,
+        {0x80, 0x80, 0x80, 0x80}, {0, 0}, 0,
+        {0, 0, 4096, 0, 0, 0}, 0,
+        {0, 0, 0, 0, 0, 0}, {0},
+        {0, 0, 4096, 0, 0, 0},
+    },
+    {
+        "full deflection", 0, 0,
+        {0xff, 0x00, 0x01, 0xff}, {0xff, 0x80}, 1 << 0 | 1 << 12,
+        {1000, -2000, 3000, 100, -200, 300}, 0,
+        {32767, 32767, -32767, -32767, 255, 128}, {BTN_DPAD_UP, BTN_A},
+        {1000, -2000, 3000, 100000, -200000, 300000},
+    },
+    {
+        "half deflection, back buttons", 0, 0,
+        {0x40, 0xc0, 0xa0, 0x60}, {0x40, 0xff}, 1 << 15 | 0xf << 16,
+        {-32767, 32767, -1000, -32767, 32767, 0}, 0,
+        {-16512, -16512, 8256, 8256, 64, 255},
+        {BTN_Y, BTN_BASE, BTN_BASE2, BTN_BASE3, BTN_BASE4},
+        {-32767, 32767, -1000, -32767000, 32767000, 0},
+    },
+    {
+        "short report is dropped", 0, 12,
+        {0x80, 0x80, 0x80, 0x80}, {0, 0}, 0,
+        {5000, 5000, 5000, 5000, 5000, 5000}, 1,
+    },
+    {
+        "unhandled id is dropped", -1, 0,
+        {0x80, 0x80, 0x80, 0x80}, {0, 0}, 0,
+        {5000, 5000, 5000, 5000, 5000, 5000}, 1,
+    },
+    {
+        "back to neutral", 0, 0,
+        {0x80, 0x80, 0x80, 0x80}, {0, 0}, 0,
+        {0, 0, 4096, 0, 0, 0}, 0,
+        {0, 0, 0, 0, 0, 0}, {0},
+        {0, 0, 4096, 0, 0, 0},
+    },
+};
+
+int golden_report(unsigned char* buf, struct golden* g) {
+    int id = g->id < 0 ? 5 : g->id ? g->id : product->wired ? 5 : 4;
+    int size = id == 4 ? REPORT4_SIZE : REPORT5_SIZE;
+
+    memset(buf, 0, REPORT5_SIZE);
+    buf[0] = id;
+    if (id == 4) {
+        memcpy(buf + 2, g->imu, sizeof(g->imu));
+    } else {
+        memcpy(buf + 2, g->sticks, 4);
+        memcpy(buf + 6, g->triggers, 2);
+        buf[8] = g->buttons;
+        buf[9] = g->buttons >> 8;
+        buf[10] = g->buttons >> 16;
+        memcpy(buf + 23, g->imu, sizeof(g->imu));
+    }
+    return g->size ? g->size : size;
+}
+
+// wait for the imu frame, the gamepad is synced before it in the same report
+int wait_imu_frame(struct bench_dev* dev, int timeout_ms) {
+    struct pollfd pfd = { .fd = dev->imu_fd, .events = POLLIN };
+    struct input_event evs[64];
+    int frames = 0;
+    ssize_t res;
+
+    while (poll(&pfd, 1, timeout_ms) > 0) {
+        while ((res = read(dev->imu_fd, evs, sizeof(evs))) > 0)
+            for (int i = 0; i < res / sizeof(evs[0]); ++i)
+                frames += evs[i].type == EV_SYN && evs[i].code == SYN_REPORT;
+        if (frames)
+            break;
+    }
+    return frames;
+}
+
+int check_abs(int fd, const char* dev_name, int code, int want) {
+    struct input_absinfo info;
+
+    if (ioctl(fd, EVIOCGABS(code), &info) < 0) {
+        perror("EVIOCGABS");
+        return 1;
+    }
+    if (info.value == want)
+        return 0;
+    printf("    %s abs 0x%02x: got %d, want %d\n", dev_name, code, info.value, want);
+    return 1;
+}
+
+int check_keys(int fd, const int* keys) {
+    unsigned char got[KEY_MAX / 8 + 1], want[KEY_MAX / 8 + 1];
+    int errors = 0;
+
+    memset(got, 0, sizeof(got));
+    memset(want, 0, sizeof(want));
+    ioctl(fd, EVIOCGKEY(sizeof(got)), got);
+    for (int i = 0; i < 8 && keys[i]; ++i)
+        want[keys[i] / 8] |= 1 << (keys[i] % 8);
+    for (int code = 0; code <= KEY_MAX; ++code) {
+        int g = !!(got[code / 8] & (1 << (code % 8)));
+        int w = !!(want[code / 8] & (1 << (code % 8)));
+        if (g != w) {
+            printf("    key 0x%03x: got %d, want %d\n", code, g, w);
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+void write_sysfs(const char* dir, const char* attr, const char* value) {
+    char path[PATH_MAX + 64];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return;
+    }
+    fputs(value, f);
+    fclose(f);
+}
+
+// the driver's own per report cost from debugfs, needs debugfs mounted
+int read_parse_cost(struct bench_dev* dev, unsigned long long* avg,
+        unsigned long long* max) {
+    char path[PATH_MAX + 64], line[256];
+    const char* hid = strrchr(dev->hid_path, '/');
+    int found = 0;
+    FILE* f;
+
+    if (!hid)
+        return 0;
+    snprintf(path, sizeof(path), "/sys/kernel/debug/hid/%s/btp_t6_stats", hid + 1);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        found += sscanf(line, "parse avg (ns): %llu", avg);
+        found += sscanf(line, "parse max (ns): %llu", max);
+    }
+    fclose(f);
+    return found == 2;
+}
+
+void reset_parse_cost(struct bench_dev* dev) {
+    char path[PATH_MAX + 64];
+    const char* hid = strrchr(dev->hid_path, '/');
+
+    if (!hid)
+        return;
+    snprintf(path, sizeof(path), "/sys/kernel/debug/hid/%s", hid + 1);
+    write_sysfs(path, "btp_t6_stats", "0");
+}
+
+int verify(struct bench_dev* dev) {
+    struct uhid_event ev;
+    struct golden* last = NULL;
+    unsigned long long avg, max;
+    uint64_t start, n = 20000;
+    int failed = 0;
+
+    // keep the bias tracker out of the gyro numbers
+    write_sysfs(dev->hid_path, "gyro_bias_enable", "0");
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_INPUT2;
+    for (int i = 0; i < sizeof(goldens) / sizeof(goldens[0]); ++i) {
+        struct golden* g = &goldens[i];
+        struct golden* want = g->dropped ? last : g;
+        int errors = 0;
+
+        if (g->id < 0 && product->wired)
+            continue;
+        drain_evdev(dev, dev->imu_fd);
+        ev.u.input2.size = golden_report(ev.u.input2.data, g);
+        if (uhid_write(dev->uhid_fd, &ev,
+                offsetof(struct uhid_event, u.input2.data) + ev.u.input2.size) < 0) {
+            perror("UHID_INPUT2");
+            return 1;
+        }
+
+        if (wait_imu_frame(dev, g->dropped ? 50 : 1000) != !g->dropped) {
+            printf("    %s\n", g->dropped ? "got a frame" : "no frame");
+            ++errors;
+        }
+        if (want) {
+            for (int k = 0; k < 6; ++k)
+                errors += check_abs(dev->imu_fd, "imu", golden_imu_abs[k], want->imu_abs[k]);
+            if (dev->ctlr_fd >= 0) {
+                for (int k = 0; k < 6; ++k)
+                    errors += check_abs(dev->ctlr_fd, "gamepad", golden_abs[k], want->abs[k]);
+                errors += check_keys(dev->ctlr_fd, want->keys);
+            }
+        }
+        printf("%-32s %s\n", g->name, errors ? "FAIL" : "ok");
+        failed += !!errors;
+        if (!g->dropped)
+            last = g;
+    }
+
+    // back to back reports, every write runs the driver to the end
+    reset_parse_cost(dev);
+    start = now_ns(CLOCK_MONOTONIC);
+    for (uint64_t i = 0; i < n; ++i) {
+        ev.u.input2.size = make_report(ev.u.input2.data, i, 0);
+        uhid_write(dev->uhid_fd, &ev,
+            offsetof(struct uhid_event, u.input2.data) + ev.u.input2.size);
+        if (i % 32 == 0) {
+            drain_evdev(dev, dev->imu_fd);
+            if (dev->ctlr_fd >= 0)
+                drain_evdev(dev, dev->ctlr_fd);
+        }
+    }
+    printf("\n%llu reports, %.0f ns per uhid write\n", (unsigned long long)n,
+        (double)(now_ns(CLOCK_MONOTONIC) - start) / n);
+    if (read_parse_cost(dev, &avg, &max))
+        printf("driver parse: avg %llu ns, max %llu ns\n", avg, max);
+
+    write_sysfs(dev->hid_path, "gyro_bias_enable", "1");
+    printf("\n%s\n", failed ? "FAILED" : "all ok");
+    return failed;
+}
+
+int cmp_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+double percentile_us(uint32_t* v, size_t n, double p) {
+    if (!n)
+        return 0;
+    return v[(size_t)((n - 1) * p)] / 1000.0;
+}
+
+int main(int argc, char** argv) {
+    int epfd, i;
+    uint64_t start, wait_end;
+    double wall;
+    unsigned long long avg, max;
+    struct rusage ru;
+    uint64_t total_sent = 0, total_frames = 0;
+    int do_verify = 0, ret = 0;
+
+    while (1) {
+        int c = getopt_long(argc, argv, optstring, options, NULL);
+
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case 'n':
+                ndevs = atoi(optarg);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 't':
+                duration = atof(optarg);
+                break;
+            case 'p':
+                for (i = 0; i < sizeof(products) / sizeof(products[0]); ++i) {
+                    if (strcmp(products[i].name, optarg) == 0)
+                        product = &products[i];
+                }
+                break;
+            case 'i':
+                if (load_recorded(optarg))
+                    return 1;
+                break;
+            case 'v':
+                do_verify = 1;
+                ndevs = 1;
+                break;
+            default:
+                break;
+        }
+    }
+    if (ndevs < 1 || ndevs > MAX_DEVICES || rate <= 0 || duration <= 0) {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    signal(SIGINT, set_exit_flag);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    for (i = 0; i < ndevs; ++i) {
+        struct bench_dev* dev = &devs[i];
+        dev->index = i;
+        dev->imu_fd = dev->ctlr_fd = -1;
+        dev->cap = rate * duration + 16;
+        dev->lat_kernel = calloc(dev->cap, sizeof(uint32_t));
+        dev->lat_user = calloc(dev->cap, sizeof(uint32_t));
+        if (!dev->lat_kernel || !dev->lat_user) {
+            perror("Unable to allocate latency buffers");
+            return 1;
+        }
+        if (create_device(dev))
+            return 1;
+    }
+
+    wait_end = now_ns(CLOCK_MONOTONIC) + 5000000000ull;
+    for (i = 0; i < ndevs; ++i) {
+        struct bench_dev* dev = &devs[i];
+        struct epoll_event ee = { .events = EPOLLIN };
+
+        while (!find_evdev(dev)) {
+            if (now_ns(CLOCK_MONOTONIC) > wait_end || is_exit) {
+                fprintf(stderr, "device %d: evdev nodes didn't show up, "
+                    "is hid-betop-t6 loaded?\n", i);
+                goto out;
+            }
+            usleep(10000);
+        }
+        ee.data.u64 = (uint64_t)i << 2 | 0;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, dev->imu_fd, &ee);
+        if (dev->ctlr_fd >= 0) {
+            ee.data.u64 = (uint64_t)i << 2 | 1;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, dev->ctlr_fd, &ee);
+        }
+        ee.data.u64 = (uint64_t)i << 2 | 2;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, dev->uhid_fd, &ee);
+    }
+
+    if (do_verify) {
+        ret = verify(&devs[0]);
+        goto out;
+    }
+
+    printf("%d x %s, %.0f Hz, %.1f s%s\n", ndevs, product->name, rate, duration,
+        recorded.count ? ", recorded stream" : "");
+    for (i = 0; i < ndevs; ++i)
+        reset_parse_cost(&devs[i]);
+
+    start = now_ns(CLOCK_MONOTONIC);
+    for (i = 0; i < ndevs; ++i)
+        pthread_create(&devs[i].writer, NULL, writer_thread, &devs[i]);
+
+    while (!is_exit && now_ns(CLOCK_MONOTONIC) < start + duration * 1e9 + 2e8) {
+        struct epoll_event ees[32];
+        int n = epoll_wait(epfd, ees, 32, 100);
+
+        for (int k = 0; k < n; ++k) {
+            struct bench_dev* dev = &devs[ees[k].data.u64 >> 2];
+            switch (ees[k].data.u64 & 3) {
+                case 0:
+                    drain_evdev(dev, dev->imu_fd);
+                    break;
+                case 1:
+                    drain_evdev(dev, dev->ctlr_fd);
+                    break;
+                case 2:
+                    drain_uhid(dev);
+                    break;
+            }
+        }
+    }
+    is_exit = 1;
+    for (i = 0; i < ndevs; ++i)
+        pthread_join(devs[i].writer, NULL);
+    wall = (now_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+    printf("\n%4s %10s %10s %10s %8s %9s %9s %9s %9s %6s\n",
+        "dev", "sent", "imu/s", "ctlr/s", "cpu%", "k p50us", "k p99us",
+        "u p50us", "u p99us", "out");
+    for (i = 0; i < ndevs; ++i) {
+        struct bench_dev* dev = &devs[i];
+        qsort(dev->lat_kernel, dev->nlat, sizeof(uint32_t), cmp_u32);
+        qsort(dev->lat_user, dev->nlat, sizeof(uint32_t), cmp_u32);
+        printf("%4d %10llu %10.1f %10.1f %8.3f %9.1f %9.1f %9.1f %9.1f %6llu\n", i,
+            (unsigned long long)dev->sent,
+            dev->imu_frames / duration, dev->ctlr_frames / duration,
+            dev->cpu_s / wall * 100,
+            percentile_us(dev->lat_kernel, dev->nlat, 0.5),
+            percentile_us(dev->lat_kernel, dev->nlat, 0.99),
+            percentile_us(dev->lat_user, dev->nlat, 0.5),
+            percentile_us(dev->lat_user, dev->nlat, 0.99),
+            (unsigned long long)dev->outputs);
+        if (dev->write_errors)
+            printf("     %llu uhid write errors\n", (unsigned long long)dev->write_errors);
+        if (read_parse_cost(dev, &avg, &max))
+            printf("     driver parse: avg %llu ns, max %llu ns\n", avg, max);
+        total_sent += dev->sent;
+        total_frames += dev->imu_frames;
+    }
+    getrusage(RUSAGE_SELF, &ru);
+    printf("\ntotal: %.1f reports/s sent, %.1f imu frames/s, process cpu %.2f%%\n",
+        total_sent / duration, total_frames / duration,
+        (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6) / wall * 100);
+
+out:
+    for (i = 0; i < ndevs; ++i) {
+        if (devs[i].imu_fd >= 0)
+            close(devs[i].imu_fd);
+        if (devs[i].ctlr_fd >= 0)
+            close(devs[i].ctlr_fd);
+        if (devs[i].uhid_fd > 0)
+            destroy_device(&devs[i]);
+        free(devs[i].lat_kernel);
+        free(devs[i].lat_user);
+    }
+    close(epfd);
+    return ret;
+}
@@ -0,0 +1,651 @@
+/*
+ * userspace stand-in for hid-betop-t6, for hosts that can't load the module.
+ *
+ * claims the T6 hidraw nodes (the interface with the 211 byte descriptor,
+ * same check as btp_t6_verify_device) and creates the input devices
+ * btp_t6_register_controller and btp_t6_register_imu would, through uinput:
+ * same names, ids, axes, ranges, resolutions, keys and MSC_TIMESTAMP.
+ * report layouts, the default keymap and axis tables, the timestamp
+ * pll and the gyro bias tracker are ports of the driver's, so the events
+ * come out the same.
+ *
+ * all controllers are read from one epoll loop on a SCHED_FIFO thread, every
+ * report turns into one write() per input device. the time from read() to
+ * the last write() is measured per report, comparable to "parse avg/max"
+ * in the driver's debugfs stats.
+ */
+
+#include "hid-ids.h"
+
+#include <linux/hidraw.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <getopt.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <glob.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define MAX_DEVICES 8
+#define RESCAN_MS 2000
+#define T6_RDESC_SIZE 211
+#define LAT_SAMPLES (1 << 16)
+
+// from hid-betop-t6.c
+#define T6_STICK_MAX 127
+#define T6_STICK_MAG 32767
+#define T6_STICK_CENTER 0x80
+#define T6_TRIGGER_MAX 255
+#define T6_IMU_ACCEL_MAX 32767
+#define T6_IMU_ACCEL_FUZZ 10
+#define T6_IMU_ACCEL_RES 4096
+#define T6_IMU_GYRO_MAX (32767 * 1000)
+#define T6_IMU_GYRO_FUZZ 10
+#define T6_IMU_GYRO_RES 16383
+#define T6_BTN_COUNT 24
+#define T6_IMU_AXES 6
+
+#define T6_CLOCK_PHASE_SHIFT 4
+#define T6_CLOCK_PERIOD_SHIFT 8
+#define T6_CLOCK_RESYNC_PERIODS 8
+
+#define T6_BIAS_WINDOW_SHIFT 5
+#define T6_BIAS_GYRO_VAR_MAX 64
+#define T6_BIAS_ACCEL_VAR_MAX 256
+#define T6_BIAS_GYRO_MEAN_MAX 256
+#define T6_BIAS_GAIN_MIN 16
+#define T6_BIAS_CONFIDENCE_MAX 100
+
+const uint16_t default_keymap[T6_BTN_COUNT] = {
+    BTN_DPAD_UP, BTN_DPAD_DOWN, BTN_DPAD_LEFT, BTN_DPAD_RIGHT,
+    BTN_START, BTN_SELECT, BTN_THUMBL, BTN_THUMBR,
+    BTN_TL, BTN_TR, KEY_RESERVED, KEY_RESERVED,
+    BTN_A, BTN_B, BTN_X, BTN_Y,
+    BTN_BASE, BTN_BASE2, BTN_BASE3, BTN_BASE4,
+};
+
+// lx ly rx ry lt rt, the order of the report
+const int ctlr_abs[] = { ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_Z, ABS_RZ };
+
+/*
+ * offsets from the start of the report, id included,
+ * -1 when the report doesn't have that block.
+ */
+struct layout {
+    int size;
+    int ctlr;
+    int imu;
+};
+
+const struct layout layout4 = { 32, -1, 2 };
+const struct layout layout5 = { 64, 2, 23 };
+
+struct product {
+    uint16_t id;
+    const char* name;
+    const char* imu_name;
+    // reports 4 and 5
+    const struct layout* reports[2];
+};
+
+const struct product products[] = {
+    { USB_DEVICE_ID_BETOP_T6_USB, "Betop T6 For USB",
+        "Betop T6 For USB IMU", { &layout4, &layout5 } },
+    { USB_DEVICE_ID_BETOP_T6_ADAPTER, "Betop T6 For Adapter",
+        "Betop T6 For Adapter IMU", { &layout4, NULL } },
+    { USB_DEVICE_ID_BETOP_T6_USB_WITH_AUDIO, "Betop T6 For USB With Audio",
+        "Betop T6 For USB With Audio IMU", { &layout4, &layout5 } },
+    { USB_DEVICE_ID_BETOP_T6_ADAPTER_WITH_AUDIO, "Betop T6 For Adapter With Audio",
+        "Betop T6 For Adapter With Audio IMU", { &layout4, NULL } },
+};
+
+struct clock_pll {
+    unsigned int samples;
+    uint64_t base_ns;
+    uint64_t rx_ns;
+    uint64_t t_ns;
+    int64_t period_q8;
+    uint32_t timestamp_us;
+};
+
+struct gyro_bias {
+    unsigned int count;
+    int32_t sum[T6_IMU_AXES];
+    int64_t sumsq[T6_IMU_AXES];
+    int32_t bias_q8[3];
+    unsigned int confidence;
+};
+
+struct t6_device {
+    int fd;
+    char path[32];
+    const struct product* product;
+    int ctlr_fd;
+    int imu_fd;
+    int16_t lut[6][256];
+    uint32_t last_btns;
+    struct clock_pll clock;
+    struct gyro_bias bias;
+
+    uint64_t reports, short_reports, unknown, write_errors;
+    uint32_t lat[LAT_SAMPLES];
+    uint64_t lat_count;
+};
+
+struct t6_device devs[MAX_DEVICES];
+int rt_prio = 20;
+int force = 0;
+int gyro_bias_enabled = 1;
+double stats_interval = 0;
+
+atomic_int is_exit = 0;
+
+char optstring[] = "r:fs:n";
+struct option options[] = {
+    {"rt-prio", required_argument, 0, 'r'},
+    {"force", no_argument, 0, 'f'},
+    {"stats", required_argument, 0, 's'},
+    {"no-gyro-bias", no_argument, 0, 'n'},
+    {0, 0, 0, 0},
+};
+
+void set_exit_flag(int sig) {
+    is_exit = 1;
+}
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int32_t div_round_closest(int64_t x, int64_t d) {
+    return x >= 0 ? (x + d / 2) / d : (x - d / 2) / d;
+}
+
+// btp_t6_axis_build with the default calibration and linear curve
+void build_luts(struct t6_device* dev) {
+    const int64_t one = 1 << 16;
+
+    for (int axis = 0; axis < 6; ++axis) {
+        for (int v = 0; v < 256; ++v) {
+            int64_t t;
+            int d;
+
+            if (axis >= 4) {
+                t = v * one / T6_TRIGGER_MAX;
+                dev->lut[axis][v] = (t * T6_TRIGGER_MAX + one / 2) >> 16;
+                continue;
+            }
+            d = v - T6_STICK_CENTER;
+            t = (d >= 0 ? (d < T6_STICK_MAX ? d : T6_STICK_MAX)
+                : (-d < T6_STICK_MAX ? -d : T6_STICK_MAX)) * one / T6_STICK_MAX;
+            t = (t * T6_STICK_MAG + one / 2) >> 16;
+            // y axes are upside down
+            if ((d < 0) != (axis == 1 || axis == 3))
+                t = -t;
+            dev->lut[axis][v] = t;
+        }
+    }
+}
+
+// btp_t6_clock_update
+void clock_update(struct clock_pll* clk, uint64_t rx_ns) {
+    int64_t period, err, corr;
+
+    if (clk->samples < 2) {
+        if (clk->samples == 0)
+            clk->base_ns = rx_ns;
+        else
+            clk->period_q8 = (int64_t)(rx_ns - clk->rx_ns) << 8;
+        clk->t_ns = rx_ns;
+        goto out;
+    }
+
+    period = clk->period_q8 >> 8;
+    err = (int64_t)(rx_ns - clk->t_ns) - period;
+
+    if (period <= 0 || err > period * T6_CLOCK_RESYNC_PERIODS ||
+            err < -period * T6_CLOCK_RESYNC_PERIODS) {
+        if (period <= 0)
+            clk->period_q8 = (int64_t)(rx_ns - clk->rx_ns) << 8;
+        clk->t_ns = rx_ns > clk->t_ns + 1 ? rx_ns : clk->t_ns + 1;
+        goto out;
+    }
+
+    corr = err >> T6_CLOCK_PHASE_SHIFT;
+    if (corr < -period / 2)
+        corr = -period / 2;
+    if (corr > period / 2)
+        corr = period / 2;
+    clk->t_ns += period + corr;
+    clk->period_q8 += err << (8 - T6_CLOCK_PERIOD_SHIFT);
+
+out:
+    clk->rx_ns = rx_ns;
+    clk->timestamp_us = (uint32_t)((clk->t_ns - clk->base_ns) / 1000);
+    if (clk->samples < 2)
+        ++clk->samples;
+}
+
+// btp_t6_gyro_bias_window / btp_t6_gyro_bias_update
+void gyro_bias_window(struct gyro_bias* gb) {
+    const int64_t n = 1 << T6_BIAS_WINDOW_SHIFT;
+    unsigned int gain;
+
+    for (int i = 0; i < T6_IMU_AXES; ++i) {
+        int64_t nvar = gb->sumsq[i] * n - (int64_t)gb->sum[i] * gb->sum[i];
+        int64_t max = i < 3 ? T6_BIAS_ACCEL_VAR_MAX : T6_BIAS_GYRO_VAR_MAX;
+        if (nvar > max * n * n)
+            return;
+    }
+    for (int i = 3; i < T6_IMU_AXES; ++i) {
+        if (abs(gb->sum[i] >> T6_BIAS_WINDOW_SHIFT) > T6_BIAS_GYRO_MEAN_MAX)
+            return;
+    }
+
+    gain = gb->confidence + 1 < T6_BIAS_GAIN_MIN ? gb->confidence + 1 : T6_BIAS_GAIN_MIN;
+    for (int i = 0; i < 3; ++i) {
+        int32_t mean_q8 = (gb->sum[i + 3] * 256) >> T6_BIAS_WINDOW_SHIFT;
+        gb->bias_q8[i] += (mean_q8 - gb->bias_q8[i]) / (int32_t)gain;
+    }
+    if (gb->confidence < T6_BIAS_CONFIDENCE_MAX)
+        ++gb->confidence;
+}
+
+void gyro_bias_update(struct gyro_bias* gb, int32_t* imu) {
+    for (int i = 0; i < T6_IMU_AXES; ++i) {
+        gb->sum[i] += imu[i];
+        gb->sumsq[i] += imu[i] * imu[i];
+    }
+    if (++gb->count == 1 << T6_BIAS_WINDOW_SHIFT) {
+        gyro_bias_window(gb);
+        gb->count = 0;
+        memset(gb->sum, 0, sizeof(gb->sum));
+        memset(gb->sumsq, 0, sizeof(gb->sumsq));
+    }
+
+    if (!gyro_bias_enabled)
+        return;
+    for (int i = 0; i < 3; ++i)
+        imu[i + 3] -= div_round_closest(gb->bias_q8[i], 256);
+}
+
+struct event_batch {
+    struct input_event evs[40];
+    int count;
+};
+
+void batch_add(struct event_batch* b, int type, int code, int value) {
+    struct input_event* ev = &b->evs[b->count++];
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+int batch_write(struct event_batch* b, int fd) {
+    ssize_t size = b->count * sizeof(b->evs[0]);
+
+    batch_add(b, EV_SYN, SYN_REPORT, 0);
+    size += sizeof(b->evs[0]);
+    return write(fd, b->evs, size) == size ? 0 : -1;
+}
+
+void parse_controller(struct t6_device* dev, const unsigned char* data, struct event_batch* b) {
+    uint32_t btns = data[6] | data[7] << 8 | data[8] << 16;
+    uint32_t changed = btns ^ dev->last_btns;
+
+    // the button word hardly ever changes, only walk the bits that did
+    for (int bit = 0; changed && bit < T6_BTN_COUNT; ++bit) {
+        if ((changed & 1u << bit) && default_keymap[bit] != KEY_RESERVED)
+            batch_add(b, EV_KEY, default_keymap[bit], !!(btns & 1u << bit));
+    }
+    dev->last_btns = btns;
+
+    for (int i = 0; i < 6; ++i)
+        batch_add(b, EV_ABS, ctlr_abs[i], dev->lut[i][data[i]]);
+}
+
+void parse_imu(struct t6_device* dev, const unsigned char* data, uint64_t rx_ns,
+        struct event_batch* b) {
+    int32_t imu[T6_IMU_AXES];
+
+    for (int i = 0; i < T6_IMU_AXES; ++i)
+        imu[i] = (int16_t)(data[i * 2] | data[i * 2 + 1] << 8);
+
+    clock_update(&dev->clock, rx_ns);
+    gyro_bias_update(&dev->bias, imu);
+
+    batch_add(b, EV_MSC, MSC_TIMESTAMP, dev->clock.timestamp_us);
+    batch_add(b, EV_ABS, ABS_X, imu[0]);
+    batch_add(b, EV_ABS, ABS_Y, imu[1]);
+    batch_add(b, EV_ABS, ABS_Z, imu[2]);
+    batch_add(b, EV_ABS, ABS_RX, imu[3] * 1000);
+    batch_add(b, EV_ABS, ABS_RY, imu[4] * 1000);
+    batch_add(b, EV_ABS, ABS_RZ, imu[5] * 1000);
+}
+
+void handle_report(struct t6_device* dev, const unsigned char* data, int size,
+        uint64_t rx_ns) {
+    const struct layout* layout = NULL;
+    struct event_batch ctlr = { .count = 0 }, imu = { .count = 0 };
+
+    ++dev->reports;
+    if (data[0] == 4 || data[0] == 5)
+        layout = dev->product->reports[data[0] - 4];
+    if (!layout) {
+        ++dev->unknown;
+        return;
+    }
+    if (size < layout->size) {
+        ++dev->short_reports;
+        return;
+    }
+
+    if (layout->ctlr >= 0)
+        parse_controller(dev, data + layout->ctlr, &ctlr);
+    if (layout->imu >= 0)
+        parse_imu(dev, data + layout->imu, rx_ns, &imu);
+
+    // same order as the driver, controller synced first
+    if (layout->ctlr >= 0 && dev->ctlr_fd >= 0 && batch_write(&ctlr, dev->ctlr_fd))
+        ++dev->write_errors;
+    if (layout->imu >= 0 && batch_write(&imu, dev->imu_fd))
+        ++dev->write_errors;
+
+    dev->lat[dev->lat_count++ % LAT_SAMPLES] = now_ns() - rx_ns;
+}
+
+void abs_setup(int fd, int code, int min, int max, int fuzz, int res) {
+    struct uinput_abs_setup abs = {
+        .code = code,
+        .absinfo = { .minimum = min, .maximum = max, .fuzz = fuzz, .resolution = res },
+    };
+
+    ioctl(fd, UI_SET_ABSBIT, code);
+    ioctl(fd, UI_ABS_SETUP, &abs);
+}
+
+// btp_t6_init_input plus the register functions, through uinput
+int create_input(struct t6_device* dev, int is_imu, struct hidraw_devinfo* info,
+        const char* phys) {
+    struct uinput_setup setup;
+    int fd = open("/dev/uinput", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd < 0) {
+        perror("/dev/uinput");
+        return -1;
+    }
+
+    memset(&setup, 0, sizeof(setup));
+    snprintf(setup.name, sizeof(setup.name), "%s",
+        is_imu ? dev->product->imu_name : dev->product->name);
+    setup.id.bustype = info->bustype;
+    setup.id.vendor = info->vendor;
+    setup.id.product = info->product;
+    ioctl(fd, UI_SET_PHYS, phys);
+
+    ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    if (is_imu) {
+        for (int i = 0; i < 3; ++i) {
+            abs_setup(fd, ABS_X + i, -T6_IMU_ACCEL_MAX, T6_IMU_ACCEL_MAX,
+                T6_IMU_ACCEL_FUZZ, T6_IMU_ACCEL_RES);
+            abs_setup(fd, ABS_RX + i, -T6_IMU_GYRO_MAX, T6_IMU_GYRO_MAX,
+                T6_IMU_GYRO_FUZZ, T6_IMU_GYRO_RES);
+        }
+        ioctl(fd, UI_SET_EVBIT, EV_MSC);
+        ioctl(fd, UI_SET_MSCBIT, MSC_TIMESTAMP);
+        ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_ACCELEROMETER);
+    } else {
+        ioctl(fd, UI_SET_EVBIT, EV_KEY);
+        for (int i = 0; i < T6_BTN_COUNT; ++i)
+            if (default_keymap[i] != KEY_RESERVED)
+                ioctl(fd, UI_SET_KEYBIT, default_keymap[i]);
+        for (int i = 0; i < 4; ++i)
+            abs_setup(fd, ctlr_abs[i], -T6_STICK_MAG, T6_STICK_MAG, 0, 0);
+        for (int i = 4; i < 6; ++i)
+            abs_setup(fd, ctlr_abs[i], 0, T6_TRIGGER_MAX, 0, 0);
+    }
+
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        perror("uinput");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int read_hidraw(struct t6_device* dev) {
+    unsigned char buf[256];
+    ssize_t size;
+
+    while ((size = read(dev->fd, buf, sizeof(buf))) > 0)
+        handle_report(dev, buf, size, now_ns());
+    return size < 0 && errno != EAGAIN ? -1 : 0;
+}
+
+int cmp_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+void print_stats(struct t6_device* dev) {
+    static uint32_t sorted[LAT_SAMPLES];
+    uint64_t n = dev->lat_count < LAT_SAMPLES ? dev->lat_count : LAT_SAMPLES;
+
+    printf("%s (%s): %llu reports", dev->product->name, dev->path,
+        (unsigned long long)dev->reports);
+    if (dev->short_reports || dev->unknown)
+        printf(", %llu short, %llu unknown", (unsigned long long)dev->short_reports,
+            (unsigned long long)dev->unknown);
+    if (dev->write_errors)
+        printf(", %llu write errors", (unsigned long long)dev->write_errors);
+    if (n) {
+        memcpy(sorted, dev->lat, n * sizeof(sorted[0]));
+        qsort(sorted, n, sizeof(sorted[0]), cmp_u32);
+        printf(", read to write p50 %u ns, p99 %u ns, max %u ns",
+            sorted[n / 2], sorted[n * 99 / 100], sorted[n - 1]);
+    }
+    printf("\n");
+}
+
+/*
+ * the kernel driver owns the node when it's bound,
+ * two of us would double every event.
+ */
+int kernel_driver_bound(const char* path) {
+    char link[PATH_MAX], target[PATH_MAX];
+    ssize_t len;
+
+    snprintf(link, sizeof(link), "/sys/class/hidraw/%s/device/driver", strrchr(path, '/') + 1);
+    len = readlink(link, target, sizeof(target) - 1);
+    if (len < 0)
+        return 0;
+    target[len] = 0;
+    return strcmp(strrchr(target, '/') ? strrchr(target, '/') + 1 : target, "btp_t6") == 0;
+}
+
+int open_device(int epfd, const char* path) {
+    struct hidraw_devinfo info;
+    char phys[256] = "";
+    int size, fd, slot;
+    const struct product* product = NULL;
+    struct t6_device* dev;
+    struct epoll_event ee = { .events = EPOLLIN };
+
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0 || (uint16_t)info.vendor != USB_VENDOR_ID_BETOP)
+        goto fail;
+    for (int i = 0; i < sizeof(products) / sizeof(products[0]); ++i)
+        if (products[i].id == (uint16_t)info.product)
+            product = &products[i];
+    // the other interface has a different descriptor, like btp_t6_verify_device
+    if (!product || ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0 || size != T6_RDESC_SIZE)
+        goto fail;
+    if (!force && kernel_driver_bound(path)) {
+        fprintf(stderr, "%s: hid-betop-t6 is bound, skipped (--force to take it anyway)\n", path);
+        goto fail;
+    }
+    for (slot = 0; slot < MAX_DEVICES && devs[slot].fd >= 0; ++slot)
+        ;
+    if (slot == MAX_DEVICES)
+        goto fail;
+
+    dev = &devs[slot];
+    memset(dev, 0, sizeof(*dev));
+    dev->fd = fd;
+    dev->ctlr_fd = dev->imu_fd = -1;
+    dev->product = product;
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+    build_luts(dev);
+    ioctl(fd, HIDIOCGRAWPHYS(sizeof(phys)), phys);
+
+    if (product->reports[1]) {
+        dev->ctlr_fd = create_input(dev, 0, &info, phys);
+        if (dev->ctlr_fd < 0)
+            goto fail_dev;
+    }
+    dev->imu_fd = create_input(dev, 1, &info, phys);
+    if (dev->imu_fd < 0)
+        goto fail_dev;
+
+    ee.data.u32 = slot;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ee);
+    printf("%s: %s\n", path, product->name);
+    return 0;
+
+fail_dev:
+    if (dev->ctlr_fd >= 0)
+        close(dev->ctlr_fd);
+    dev->fd = -1;
+fail:
+    close(fd);
+    return -1;
+}
+
+void destroy_device(int epfd, struct t6_device* dev) {
+    print_stats(dev);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, dev->fd, NULL);
+    close(dev->fd);
+    dev->fd = -1;
+    if (dev->ctlr_fd >= 0) {
+        ioctl(dev->ctlr_fd, UI_DEV_DESTROY);
+        close(dev->ctlr_fd);
+    }
+    ioctl(dev->imu_fd, UI_DEV_DESTROY);
+    close(dev->imu_fd);
+}
+
+void scan_devices(int epfd) {
+    glob_t g;
+
+    if (glob("/dev/hidraw*", 0, NULL, &g))
+        return;
+    for (size_t i = 0; i < g.gl_pathc; ++i) {
+        int taken = 0;
+        for (int s = 0; s < MAX_DEVICES; ++s)
+            taken |= devs[s].fd >= 0 && strcmp(devs[s].path, g.gl_pathv[i]) == 0;
+        if (!taken)
+            open_device(epfd, g.gl_pathv[i]);
+    }
+    globfree(&g);
+}
+
+void set_realtime() {
+    struct sched_param param = { .sched_priority = rt_prio };
+
+    if (!rt_prio)
+        return;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+        fprintf(stderr, "SCHED_FIFO %d: %s, running at normal priority\n",
+            rt_prio, strerror(errno));
+    // no page faults in the report path
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        fprintf(stderr, "mlockall: %s\n", strerror(errno));
+}
+
+int main(int argc, char** argv) {
+    struct epoll_event events[MAX_DEVICES];
+    uint64_t last_scan = 0, last_stats;
+    int epfd;
+
+    while (1) {
+        int c = getopt_long(argc, argv, optstring, options, NULL);
+
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'r':
+                rt_prio = atoi(optarg);
+                break;
+            case 'f':
+                force = 1;
+                break;
+            case 's':
+                stats_interval = atof(optarg);
+                break;
+            case 'n':
+                gyro_bias_enabled = 0;
+                break;
+            default:
+                break;
+        }
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGINT, set_exit_flag);
+    signal(SIGTERM, set_exit_flag);
+    for (int s = 0; s < MAX_DEVICES; ++s)
+        devs[s].fd = -1;
+
+    set_realtime();
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    last_stats = now_ns();
+
+    while (!is_exit) {
+        uint64_t now = now_ns();
+        int n;
+
+        if (now - last_scan >= RESCAN_MS * 1000000ull) {
+            scan_devices(epfd);
+            last_scan = now;
+        }
+        if (stats_interval > 0 && now - last_stats >= stats_interval * 1e9) {
+            for (int s = 0; s < MAX_DEVICES; ++s)
+                if (devs[s].fd >= 0)
+                    print_stats(&devs[s]);
+            last_stats = now;
+        }
+        n = epoll_wait(epfd, events, MAX_DEVICES, RESCAN_MS);
+        for (int i = 0; i < n; ++i) {
+            uint32_t s = events[i].data.u32;
+
+            if (devs[s].fd >= 0 && read_hidraw(&devs[s]) < 0) {
+                fprintf(stderr, "%s: gone\n", devs[s].path);
+                destroy_device(epfd, &devs[s]);
+            }
+        }
+    }
+
+    for (int s = 0; s < MAX_DEVICES; ++s)
+        if (devs[s].fd >= 0)
+            destroy_device(epfd, &devs[s]);
+    close(epfd);
+    return 0;
+}